@@ -5,6 +5,11 @@
 #include "EngineUtils.h"
 #include "NavigationNode.h"
 #include "EnemyCharacter.h"
+#include "ProcedurallyGeneratedMap.h"
+#include "Async/ParallelFor.h"
+#include "Async/Async.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
 
 // Sets default values
 AAIManager::AAIManager()
@@ -13,6 +18,42 @@ AAIManager::AAIManager()
 	PrimaryActorTick.bCanEverTick = true;
 
 	AllowedAngle = 0.4f;
+	PathSearchMode = PathfindingMode::ASTAR;
+	bUseHierarchicalPathfinding = false;
+	HierarchicalClusterSize = 16;
+	NumLandmarks = 8;
+	LandmarkExpandedNodeReduction = 0.0f;
+	bLandmarksDirty = false;
+	LandmarkUpdateDelay = 0.0f;
+	LandmarkGraphVersion = 0;
+	PendingLandmarkGraphVersion = 0;
+	JumpPointExpandedNodeReduction = 0.0f;
+	NavigationGridWidth = 0;
+	NavigationGridHeight = 0;
+	bSpawnDebugNodes = false;
+	DebugNodeAreaMin = FIntPoint(0, 0);
+	DebugNodeAreaMax = FIntPoint(20, 20);
+	bNavigationGraphFromActors = true;
+	bNavigationGraphDirty = true;
+	PathQueryBudgetMs = 1.0f;
+	bRunPathQueriesOnWorkerThreads = false;
+	NextPathQueryHandle = 0;
+	PathCacheCapacity = 64;
+	PathCacheHits = 0;
+	PathCacheSuffixHits = 0;
+	PathCacheMisses = 0;
+	bUseIntegrationFields = true;
+	ProceduralMap = nullptr;
+	bUpdateAgentsOnWorkerThreads = true;
+	SignificanceDistance = 3000.0f;
+	SignificanceDecisionIntervals = { 0.0f, 0.1f, 0.3f };
+	bUseBatchedPerception = true;
+	PerceptionSightRadius = 3000.0f;
+	PerceptionLoseSightRadius = 3500.0f;
+	PerceptionPeripheralVisionAngle = 90.0f;
+	PerceptionChecksPerFrame = 32;
+	bRunLineOfSightOnWorkerThreads = true;
+	PerceptionCursor = 0;
 }
 
 // Called when the game starts or when spawned
@@ -20,162 +61,884 @@ void AAIManager::BeginPlay()
 {
 	Super::BeginPlay();
 	
-	if (AllNodes.Num() == 0)
+	PathCache.SetCapacity(PathCacheCapacity);
+
+	for (TActorIterator<AProcedurallyGeneratedMap> It(GetWorld()); It; ++It)
 	{
-		UE_LOG(LogTemp, Display, TEXT("POPULATING NODES"))
-		PopulateNodes();
+		if (It->AIManager == this)
+		{
+			ProceduralMap = *It;
+			break;
+		}
+	}
+
+	// The navigation graph is not saved with the level so rebuild it from the procedural map that owns this manager
+	if (NavigationGraph.Num() == 0 && ProceduralMap)
+	{
+		FTerrainSnapshotPtr Terrain = ProceduralMap->GetTerrainSnapshot();
+		if (Terrain.IsValid() && Terrain->Num() > 0)
+		{
+			GenerateNodes(*Terrain);
+		}
+	}
+
+	// Otherwise fall back to the hand placed node actors
+	if (NavigationGraph.Num() == 0)
+	{
+		if (AllNodes.Num() == 0)
+		{
+			UE_LOG(LogTemp, Display, TEXT("POPULATING NODES"))
+			PopulateNodes();
+		}
+		else
+		{
+			RebuildNavigationGraph();
+		}
 	}
 	CreateAgents();
-	UE_LOG(LogTemp, Warning, TEXT("Number of nodes: %i"), AllNodes.Num())
+	UE_LOG(LogTemp, Warning, TEXT("Number of nodes: %i"), NavigationGraph.Num())
 }
 
 // Called every frame
 void AAIManager::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
-	
+
+	UpdateLandmarks(DeltaTime);
+	ProcessPathQueries();
+	UpdatePerception();
+	UpdateAgents(DeltaTime);
+
+	// Forget the fields of targets that no longer exist
+	for (auto It = IntegrationFields.CreateIterator(); It; ++It)
+	{
+		if (!It->Key.IsValid())
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+bool AAIManager::HasLineOfSight(const FVector& From, const FVector& To) const
+{
+	return !ProceduralMap || ProceduralMap->HasLineOfSight(From, To);
+}
+
+TArray<int32> AAIManager::GeneratePath(int32 StartNode, int32 EndNode)
+{
+	if (bNavigationGraphDirty)
+	{
+		RebuildNavigationGraph();
+	}
+
+	TArray<int32> Path;
+	if (!FindCachedPath(StartNode, EndNode, Path) && FindPath(StartNode, EndNode, SearchScratch, Path))
+	{
+		PathCache.Add(StartNode, EndNode, Path);
+	}
+	return Path;
+}
+
+bool AAIManager::FindCachedPath(int32 StartNode, int32 EndNode, TArray<int32>& OutPath)
+{
+	if (PathCache.GetCapacity() == 0)
+	{
+		return false;
+	}
+
+	switch (PathCache.Find(StartNode, EndNode, OutPath))
+	{
+	case FNavigationPathCache::ELookupResult::Hit:
+		PathCacheHits++;
+		return true;
+	case FNavigationPathCache::ELookupResult::SuffixHit:
+		PathCacheSuffixHits++;
+		return true;
+	default:
+		PathCacheMisses++;
+		return false;
+	}
+}
+
+bool AAIManager::FindPath(int32 StartNode, int32 EndNode, FNavigationSearchScratch& Scratch, TArray<int32>& OutPath) const
+{
+	// Without this the search would explore every node reachable from the start before giving up
+	if (!AreNodesConnected(StartNode, EndNode))
+	{
+		OutPath.Reset();
+		return false;
+	}
+	if (PathSearchMode == PathfindingMode::JUMP_POINT_SEARCH && JumpPointSearch.IsBuilt())
+	{
+		return JumpPointSearch.FindPath(NavigationGraph, StartNode, EndNode, Scratch, OutPath);
+	}
+	if (PathSearchMode == PathfindingMode::ASTAR_LANDMARKS && Landmarks.IsBuilt() && !bLandmarksDirty)
+	{
+		return NavigationGraph.FindPath(StartNode, EndNode, Scratch, OutPath, &Landmarks);
+	}
+	return NavigationGraph.FindPath(StartNode, EndNode, Scratch, OutPath);
 }
 
-TArray<ANavigationNode*> AAIManager::GeneratePath(ANavigationNode* StartNode, ANavigationNode* EndNode)
+int32 AAIManager::GetIntegrationFieldStep(AActor* Target, int32 FromNode, bool bTowardsTarget)
 {
-	// Create the open set array and add the start node
-	TArray<ANavigationNode*> OpenSet;
-	OpenSet.Add(StartNode);
+	if (!Target || !NavigationGraph.IsValidNode(FromNode))
+	{
+		return INDEX_NONE;
+	}
+
+	const int32 TargetNode = FindNearestNode(Target->GetActorLocation());
+	// Rebuild the field only when the target has moved onto a different node or a change to the graph may have made
+	// the cost of the agent's node stale
+	FIntegrationField& Field = IntegrationFields.FindOrAdd(Target);
+	const bool bStale = Field.Costs.Num() == NavigationGraph.Num() && Field.ExactCost < TNumericLimits<float>::Max() && Field.Costs[FromNode] >= Field.ExactCost;
+	if (Field.Costs.Num() != NavigationGraph.Num() || Field.TargetNode != TargetNode || bStale)
+	{
+		Field.TargetNode = TargetNode;
+		Field.ExactCost = TNumericLimits<float>::Max();
+		NavigationGraph.BuildCostField(TargetNode, SearchScratch, Field.Costs);
+	}
+
+	// Follow the gradient down towards the target or up away from it
+	int32 NextNode = INDEX_NONE;
+	float BestCost = Field.Costs[FromNode];
+	for (int32 Edge = NavigationGraph.EdgeOffsets[FromNode]; Edge < NavigationGraph.EdgeOffsets[FromNode + 1]; Edge++)
+	{
+		const int32 Neighbour = NavigationGraph.EdgeTargets[Edge];
+		const float Cost = Field.Costs[Neighbour];
+		if (bTowardsTarget ? Cost < BestCost : (Cost > BestCost && Cost < TNumericLimits<float>::Max()))
+		{
+			BestCost = Cost;
+			NextNode = Neighbour;
+		}
+	}
+	return NextNode;
+}
+
+TArray<int32> AAIManager::GenerateHierarchicalPath(int32 StartNode, int32 EndNode)
+{
+	TArray<int32> Waypoints;
+	if (!AreNodesConnected(StartNode, EndNode))
+	{
+		return Waypoints;
+	}
+	if (!CanUseHierarchicalPath() || !NavigationHierarchy.FindAbstractPath(NavigationGraph, StartNode, EndNode, SearchScratch, HierarchySearchScratch, Waypoints))
+	{
+		// Every step of a full path is a valid leg so fall back to the normal search
+		return GeneratePath(StartNode, EndNode);
+	}
+	return Waypoints;
+}
+
+TArray<int32> AAIManager::RefinePathSegment(int32 FromNode, int32 ToNode)
+{
+	TArray<int32> Path;
+	if (!CanUseHierarchicalPath() || !NavigationHierarchy.RefineSegment(NavigationGraph, FromNode, ToNode, SearchScratch, Path))
+	{
+		return GeneratePath(FromNode, ToNode);
+	}
+	return Path;
+}
+
+int32 AAIManager::RequestPath(int32 StartNode, int32 EndNode, const FPathQueryDelegate& OnComplete)
+{
+	FPathQuery& Query = QueuePathQuery(EPathQueryType::Full, StartNode, EndNode);
+	Query.OnComplete = OnComplete;
+	return Query.Handle;
+}
+
+int32 AAIManager::RequestHierarchicalPath(int32 StartNode, int32 EndNode, const FHierarchicalPathQueryDelegate& OnComplete)
+{
+	FPathQuery& Query = QueuePathQuery(EPathQueryType::Hierarchical, StartNode, EndNode);
+	Query.OnHierarchicalComplete = OnComplete;
+	return Query.Handle;
+}
+
+int32 AAIManager::RequestPathSegment(int32 FromNode, int32 ToNode, const FPathQueryDelegate& OnComplete)
+{
+	FPathQuery& Query = QueuePathQuery(EPathQueryType::Segment, FromNode, ToNode);
+	Query.OnComplete = OnComplete;
+	return Query.Handle;
+}
+
+AAIManager::FPathQuery& AAIManager::QueuePathQuery(EPathQueryType Type, int32 StartNode, int32 EndNode)
+{
+	FPathQuery& Query = PendingPathQueries.AddDefaulted_GetRef();
+	Query.Type = Type;
+	Query.Handle = NextPathQueryHandle++;
+	Query.StartNode = StartNode;
+	Query.EndNode = EndNode;
+	Query.bFromCache = false;
+	Query.bFullPath = Type == EPathQueryType::Full;
+	if (NextPathQueryHandle < 0)
+	{
+		NextPathQueryHandle = 0;
+	}
+	return Query;
+}
+
+void AAIManager::CancelPathQuery(int32 Handle)
+{
+	PendingPathQueries.RemoveAll([Handle](const FPathQuery& Query) { return Query.Handle == Handle; });
+}
+
+void AAIManager::ProcessPathQueries()
+{
+	if (PendingPathQueries.Num() == 0)
+	{
+		return;
+	}
+
+	if (bNavigationGraphDirty)
+	{
+		RebuildNavigationGraph();
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	const double Budget = PathQueryBudgetMs / 1000.0;
+	const int32 BatchSize = bRunPathQueriesOnWorkerThreads ? FTaskGraphInterface::Get().GetNumWorkerThreads() + 1 : 1;
+	if (WorkerSearchScratch.Num() < BatchSize)
+	{
+		WorkerSearchScratch.SetNum(BatchSize);
+		WorkerHierarchyScratch.SetNum(BatchSize);
+	}
 
-	// Set all the GScores to infinity
-	for (auto It = AllNodes.CreateIterator(); It; ++It)
+	// Always run at least one batch so queries cannot starve when the budget is very small
+	do
 	{
-		(*It)->GScore = TNumericLimits<float>::Max();
+		TArray<FPathQuery> Batch;
+		const int32 NumInBatch = FMath::Min(BatchSize, PendingPathQueries.Num());
+		Batch.Append(PendingPathQueries.GetData(), NumInBatch);
+		PendingPathQueries.RemoveAt(0, NumInBatch, false);
+
+		// Hierarchical routes and legs are not full paths so they are never looked up in the path cache
+		for (FPathQuery& Query : Batch)
+		{
+			Query.bFromCache = Query.Type == EPathQueryType::Full && FindCachedPath(Query.StartNode, Query.EndNode, Query.Path);
+		}
+
+		// The graph is not modified while the batch runs so each search only needs its own scratch
+		ParallelFor(Batch.Num(), [this, &Batch](int32 Index)
+		{
+			if (!Batch[Index].bFromCache)
+			{
+				RunPathQuery(Batch[Index], WorkerSearchScratch[Index], WorkerHierarchyScratch[Index]);
+			}
+		}, !bRunPathQueriesOnWorkerThreads);
+
+		// Callbacks may queue new queries so only run them once the batch is finished
+		for (FPathQuery& Query : Batch)
+		{
+			if (Query.bFullPath && Query.Type != EPathQueryType::Segment && !Query.bFromCache)
+			{
+				PathCache.Add(Query.StartNode, Query.EndNode, Query.Path);
+			}
+			Query.OnComplete.ExecuteIfBound(Query.Path);
+			Query.OnHierarchicalComplete.ExecuteIfBound(Query.Path, Query.bFullPath);
+		}
+	} while (PendingPathQueries.Num() > 0 && FPlatformTime::Seconds() - StartTime < Budget);
+}
+
+void AAIManager::RunPathQuery(FPathQuery& Query, FNavigationSearchScratch& Scratch, FNavigationSearchScratch& HierarchyScratch) const
+{
+	if (Query.Type == EPathQueryType::Hierarchical && CanUseHierarchicalPath() && AreNodesConnected(Query.StartNode, Query.EndNode)
+		&& NavigationHierarchy.FindAbstractPath(NavigationGraph, Query.StartNode, Query.EndNode, Scratch, HierarchyScratch, Query.Path))
+	{
+		return;
 	}
+	if (Query.Type == EPathQueryType::Segment && CanUseHierarchicalPath()
+		&& NavigationHierarchy.RefineSegment(NavigationGraph, Query.StartNode, Query.EndNode, Scratch, Query.Path))
+	{
+		return;
+	}
+	// The normal search is the fallback for both, and the caller is told it got every node rather than waypoints
+	FindPath(Query.StartNode, Query.EndNode, Scratch, Query.Path);
+	Query.bFullPath = true;
+}
 
-	// Set start node GScore to zero and update the heuristic
-	StartNode->GScore = 0.0f;
-	StartNode->HScore = FVector::Dist(StartNode->GetActorLocation(), EndNode->GetActorLocation());
+void AAIManager::RebuildNavigationGraph()
+{
+	TArray<FVector> Positions;
+	TArray<TArray<int32>> Adjacency;
+	Positions.Reserve(AllNodes.Num());
+	Adjacency.SetNum(AllNodes.Num());
 
-	ANavigationNode* CurrentNode;
+	for (int32 i = 0; i < AllNodes.Num(); i++)
+	{
+		AllNodes[i]->NodeIndex = i;
+		Positions.Add(AllNodes[i]->GetActorLocation());
+	}
 
-	// Loop through the open set until it is empty
-	while (OpenSet.Num() > 0)
+	for (int32 i = 0; i < AllNodes.Num(); i++)
 	{
-		// Find the node with the lowest FScore
-		ANavigationNode* BestNode = OpenSet[0];
-		for (auto It = OpenSet.CreateConstIterator(); It; ++It)
+		for (ANavigationNode* ConnectedNode : AllNodes[i]->ConnectedNodes)
 		{
-			// If the best node is the current node then skip
-			if (*It == BestNode) continue;
-			// If the current nodes fscore is better than the 
-			// best nodes fscore then set the current node as the best node
-			if ((*It)->FScore() < BestNode->FScore())
+			// Ignore connections to nodes the manager does not know about
+			if (ConnectedNode && AllNodes.IsValidIndex(ConnectedNode->NodeIndex) && AllNodes[ConnectedNode->NodeIndex] == ConnectedNode)
 			{
-				BestNode = *It;
+				Adjacency[i].Add(ConnectedNode->NodeIndex);
 			}
 		}
-		// When this loop finishes, the BestNode will be the node with the lowest FScore in the open set
-		CurrentNode = BestNode;
-		OpenSet.Remove(CurrentNode);
+	}
+
+	NavigationGraph.Build(Positions, Adjacency);
+	LabelComponents();
+	PathCache.Empty();
+	IntegrationFields.Empty();
+	NavigationSpatialIndex.Build(NavigationGraph.Positions);
+	JumpPointSearch.Empty();
+	NavigationHierarchy.Empty();
+	NavigationGridWidth = 0;
+	NavigationGridHeight = 0;
+	bNavigationGraphFromActors = true;
+	bNavigationGraphDirty = false;
+	BuildLandmarks();
+}
+
+void AAIManager::PopulateNodes()
+{
+	for (TActorIterator<ANavigationNode> It(GetWorld()); It; ++It)
+	{
+		AllNodes.Add(*It);
+	}
+	RebuildNavigationGraph();
+}
+
+void AAIManager::FAgentUpdateData::SetNum(int32 Num)
+{
+	States.SetNumUninitialized(Num, false);
+	CurrentNodes.SetNumUninitialized(Num, false);
+	HealthFractions.SetNumUninitialized(Num, false);
+	NodeAccuracies.SetNumUninitialized(Num, false);
+	Locations.SetNumUninitialized(Num, false);
+	CanSee.SetNumUninitialized(Num, false);
+	NextStates.SetNumUninitialized(Num, false);
+	AtCurrentNode.SetNumUninitialized(Num, false);
+	MoveInputs.SetNumUninitialized(Num, false);
+	DecisionDue.SetNumUninitialized(Num, false);
+	NextTiers.SetNumUninitialized(Num, false);
+}
+
+void AAIManager::AddAgent(AEnemyCharacter* Agent)
+{
+	// The agent is updated along with the others in UpdateAgents rather than ticking on its own
+	Agent->SetActorTickEnabled(false);
+	AllAgents.Add(Agent);
+	if (IsUsingBatchedPerception())
+	{
+		Agent->UsePerceptionFromManager();
+	}
+	AgentData.SignificanceTiers.Add(0);
+	AgentData.DecisionTimers.Add(0.0f);
+}
+
+void AAIManager::RemoveDestroyedAgents()
+{
+	// Agents added to AllAgents directly start in the first tier
+	AgentData.SignificanceTiers.SetNumZeroed(AllAgents.Num());
+	AgentData.DecisionTimers.SetNumZeroed(AllAgents.Num());
+
+	// Agents that have been destroyed are nulled by the garbage collector
+	for (int32 i = AllAgents.Num() - 1; i >= 0; i--)
+	{
+		if (!IsValid(AllAgents[i]))
+		{
+			AllAgents.RemoveAtSwap(i, 1, false);
+			AgentData.SignificanceTiers.RemoveAtSwap(i, 1, false);
+			AgentData.DecisionTimers.RemoveAtSwap(i, 1, false);
+		}
+	}
+}
+
+void AAIManager::UpdatePerception()
+{
+	RemoveDestroyedAgents();
+	const int32 NumAgents = AllAgents.Num();
+	if (!IsUsingBatchedPerception() || NumAgents == 0)
+	{
+		return;
+	}
+
+	TArray<APawn*> Targets;
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		APlayerController* PlayerController = It->Get();
+		if (PlayerController && PlayerController->GetPawn())
+		{
+			Targets.Add(PlayerController->GetPawn());
+		}
+	}
 
-		// If the current node is the end node then we have the path and should reconstruct it
-		if (CurrentNode == EndNode)
+	// Agents not checked this frame may still be holding a pawn that died or was replaced on respawn, which they would
+	// keep firing at and building integration fields for until their next check
+	for (AEnemyCharacter* Agent : AllAgents)
+	{
+		if (Agent->DetectedActor && !Targets.Contains(Agent->DetectedActor))
 		{
-			return ReconstructPath(StartNode, EndNode);
+			Agent->DetectedActor = nullptr;
+			Agent->bCanSeeActor = false;
 		}
+	}
+
+	const float CellSize = FMath::Max3(PerceptionSightRadius, PerceptionLoseSightRadius, 1.0f);
+	auto GetCell = [CellSize](const FVector& Location)
+	{
+		return FIntPoint(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize));
+	};
+	TMap<FIntPoint, TArray<int32>> TargetGrid;
+	for (int32 Target = 0; Target < Targets.Num(); Target++)
+	{
+		TargetGrid.FindOrAdd(GetCell(Targets[Target]->GetActorLocation())).Add(Target);
+	}
 
-		// Loop through all of the connected nodes of the current node
-		for (auto It = CurrentNode->ConnectedNodes.CreateIterator(); It; ++It)
+	struct FPerceptionCheck
+	{
+		AEnemyCharacter* Agent;
+		int32 SeenTarget;
+		float SeenDistanceSquared;
+	};
+	struct FPerceptionCandidate
+	{
+		int32 Check;
+		int32 Target;
+		float DistanceSquared;
+	};
+	TArray<FPerceptionCheck> Checks;
+	TArray<FPerceptionCandidate> Candidates;
+	TArray<FLineOfSightQuery> Queries;
+
+	const float CosPeripheralAngle = FMath::Cos(FMath::DegreesToRadians(PerceptionPeripheralVisionAngle));
+	const int32 NumToCheck = FMath::Min(NumAgents, FMath::Max(PerceptionChecksPerFrame, 1));
+	for (int32 n = 0; n < NumToCheck; n++)
+	{
+		AEnemyCharacter* Agent = AllAgents[(PerceptionCursor + n) % NumAgents];
+		const int32 Check = Checks.Add({ Agent, INDEX_NONE, 0.0f });
+		const FVector EyeLocation = Agent->GetPawnViewLocation();
+		const FVector Forward = Agent->GetActorForwardVector();
+		const FIntPoint AgentCell = GetCell(EyeLocation);
+
+		for (int32 CellY = AgentCell.Y - 1; CellY <= AgentCell.Y + 1; CellY++)
 		{
-			float TentativeGScore = CurrentNode->GScore + FVector::Dist(CurrentNode->GetActorLocation(), (*It)->GetActorLocation());
-			if (TentativeGScore < (*It)->GScore)
+			for (int32 CellX = AgentCell.X - 1; CellX <= AgentCell.X + 1; CellX++)
 			{
-				(*It)->CameFrom = CurrentNode;
-				(*It)->GScore = TentativeGScore;
-				(*It)->HScore = FVector::Dist((*It)->GetActorLocation(), EndNode->GetActorLocation());
-				if (!OpenSet.Contains(*It))
+				const TArray<int32>* CellTargets = TargetGrid.Find(FIntPoint(CellX, CellY));
+				if (!CellTargets)
+				{
+					continue;
+				}
+				for (int32 Target : *CellTargets)
 				{
-					OpenSet.Add(*It);
+					// A player that is already being watched is kept until it leaves the larger radius, wherever the agent faces
+					const bool bWatched = Agent->bCanSeeActor && Agent->DetectedActor == Targets[Target];
+					const float Radius = bWatched ? PerceptionLoseSightRadius : PerceptionSightRadius;
+					const FVector ToTarget = Targets[Target]->GetActorLocation() - EyeLocation;
+					const float DistanceSquared = ToTarget.SizeSquared();
+					if (DistanceSquared > Radius * Radius)
+					{
+						continue;
+					}
+					if (!bWatched && FVector::DotProduct(ToTarget.GetSafeNormal(), Forward) < CosPeripheralAngle)
+					{
+						continue;
+					}
+					Candidates.Add({ Check, Target, DistanceSquared });
+					Queries.Emplace(EyeLocation, Targets[Target]->GetActorLocation());
 				}
 			}
 		}
 	}
+	PerceptionCursor = (PerceptionCursor + NumToCheck) % NumAgents;
 
-	// If it exists this loop then no valid path has been found so return an empty path.
+	TArray<bool> Visible;
+	ProceduralMap->HasLineOfSightBatch(Queries, Visible, bRunLineOfSightOnWorkerThreads);
 
-	return TArray<ANavigationNode*>();
+	// Each agent sees the nearest of the players it has a clear view of
+	for (int32 Candidate = 0; Candidate < Candidates.Num(); Candidate++)
+	{
+		FPerceptionCheck& Check = Checks[Candidates[Candidate].Check];
+		if (Visible[Candidate] && (Check.SeenTarget == INDEX_NONE || Candidates[Candidate].DistanceSquared < Check.SeenDistanceSquared))
+		{
+			Check.SeenTarget = Candidates[Candidate].Target;
+			Check.SeenDistanceSquared = Candidates[Candidate].DistanceSquared;
+		}
+	}
+
+	for (const FPerceptionCheck& Check : Checks)
+	{
+		Check.Agent->bCanSeeActor = Check.SeenTarget != INDEX_NONE;
+		if (Check.Agent->bCanSeeActor)
+		{
+			Check.Agent->DetectedActor = Targets[Check.SeenTarget];
+		}
+	}
 }
 
-TArray<ANavigationNode*> AAIManager::ReconstructPath(ANavigationNode* StartNode, ANavigationNode* EndNode)
+int32 AAIManager::GetSignificanceTierForDistance(float Distance) const
 {
-	TArray<ANavigationNode*> Path;
-	ANavigationNode* CurrentNode = EndNode;
-	while (CurrentNode != StartNode)
+	const int32 MaxTier = FMath::Max(SignificanceDecisionIntervals.Num(), 1) - 1;
+	if (SignificanceDistance <= 0.0f)
 	{
-		Path.Add(CurrentNode);
-		CurrentNode = CurrentNode->CameFrom;
+		return 0;
 	}
-	return Path;
+	return FMath::Clamp(FMath::FloorToInt(FMath::Min(Distance / SignificanceDistance, float(MaxTier))), 0, MaxTier);
 }
 
-void AAIManager::PopulateNodes()
+float AAIManager::GetDecisionInterval(int32 Tier) const
 {
-	for (TActorIterator<ANavigationNode> It(GetWorld()); It; ++It)
+	return SignificanceDecisionIntervals.IsValidIndex(Tier) ? SignificanceDecisionIntervals[Tier] : 0.0f;
+}
+
+void AAIManager::UpdateAgents(float DeltaTime)
+{
+	RemoveDestroyedAgents();
+	const int32 NumAgents = AllAgents.Num();
+	AgentsPerSignificanceTier.Init(0, FMath::Max(SignificanceDecisionIntervals.Num(), 1));
+	if (NumAgents == 0)
 	{
-		AllNodes.Add(*It);
+		return;
+	}
+	if (bNavigationGraphDirty)
+	{
+		RebuildNavigationGraph();
+	}
+
+	TArray<FVector> PlayerLocations;
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		APlayerController* PlayerController = It->Get();
+		if (PlayerController && PlayerController->GetPawn())
+		{
+			PlayerLocations.Add(PlayerController->GetPawn()->GetActorLocation());
+		}
+	}
+
+	// Gather everything the update reads from the actors in one pass
+	AgentData.SetNum(NumAgents);
+	for (int32 i = 0; i < NumAgents; i++)
+	{
+		const AEnemyCharacter* Agent = AllAgents[i];
+		AgentData.States[i] = Agent->CurrentAgentState;
+		AgentData.CurrentNodes[i] = Agent->CurrentNode;
+		AgentData.HealthFractions[i] = Agent->GetHealthFraction();
+		AgentData.NodeAccuracies[i] = Agent->PathfindingNodeAccuracy;
+		AgentData.Locations[i] = Agent->GetActorLocation();
+		AgentData.CanSee[i] = Agent->bCanSeeActor;
+	}
+
+	// The intervals can be edited while playing, so an agent left in a tier that no longer exists decides straight away
+	// and is given a tier from the current list
+	const int32 MaxTier = AgentsPerSignificanceTier.Num() - 1;
+	for (int32 i = 0; i < NumAgents; i++)
+	{
+		if (AgentData.SignificanceTiers[i] > MaxTier)
+		{
+			AgentData.SignificanceTiers[i] = MaxTier;
+			AgentData.DecisionTimers[i] = 0.0f;
+		}
+	}
+
+	// Only the packed arrays and the graph are read here so the agents can be split across threads
+	ParallelFor(NumAgents, [this, DeltaTime, &PlayerLocations](int32 i)
+	{
+		AgentData.DecisionTimers[i] -= DeltaTime;
+		AgentData.DecisionDue[i] = AgentData.DecisionTimers[i] <= 0.0f;
+		AgentData.NextTiers[i] = AgentData.SignificanceTiers[i];
+		if (AgentData.DecisionDue[i])
+		{
+			AgentData.NextStates[i] = AEnemyCharacter::GetNextState(AgentData.States[i], AgentData.CanSee[i], AgentData.HealthFractions[i]);
+
+			int32 Tier = 0;
+			if (!AgentData.CanSee[i] && AgentData.NextStates[i] == AgentState::PATROL)
+			{
+				float PlayerDistanceSquared = TNumericLimits<float>::Max();
+				for (const FVector& PlayerLocation : PlayerLocations)
+				{
+					PlayerDistanceSquared = FMath::Min(PlayerDistanceSquared, FVector::DistSquared(PlayerLocation, AgentData.Locations[i]));
+				}
+				const float PlayerDistance = FMath::Sqrt(PlayerDistanceSquared);
+				Tier = GetSignificanceTierForDistance(PlayerDistance);
+				// Coming closer raises the significance straight away but it is only lowered a little past the boundary
+				if (Tier > AgentData.SignificanceTiers[i])
+				{
+					Tier = FMath::Max(AgentData.SignificanceTiers[i], GetSignificanceTierForDistance(PlayerDistance - SIGNIFICANCE_HYSTERESIS));
+				}
+			}
+			AgentData.NextTiers[i] = Tier;
+		}
+
+		const int32 Node = AgentData.CurrentNodes[i];
+		if (NavigationGraph.Positions.IsValidIndex(Node))
+		{
+			AgentData.MoveInputs[i] = NavigationGraph.Positions[Node] - AgentData.Locations[i];
+			AgentData.AtCurrentNode[i] = AgentData.MoveInputs[i].IsNearlyZero(AgentData.NodeAccuracies[i]);
+		}
+		else
+		{
+			AgentData.MoveInputs[i] = FVector::ZeroVector;
+			AgentData.AtCurrentNode[i] = false;
+		}
+	}, !bUpdateAgentsOnWorkerThreads);
+
+	// Agents a player can see are kept at a tier where their coarser movement is not noticeable
+	TArray<FLineOfSightQuery> VisibilityQueries;
+	TArray<int32> VisibilityAgents;
+	for (int32 i = 0; i < NumAgents; i++)
+	{
+		if (AgentData.DecisionDue[i] && AgentData.NextTiers[i] > 1)
+		{
+			for (const FVector& PlayerLocation : PlayerLocations)
+			{
+				VisibilityQueries.Emplace(PlayerLocation, AgentData.Locations[i]);
+				VisibilityAgents.Add(i);
+			}
+		}
+	}
+	if (ProceduralMap && VisibilityQueries.Num() > 0)
+	{
+		TArray<bool> Visible;
+		ProceduralMap->HasLineOfSightBatch(VisibilityQueries, Visible, bRunLineOfSightOnWorkerThreads);
+		for (int32 Query = 0; Query < Visible.Num(); Query++)
+		{
+			if (Visible[Query])
+			{
+				AgentData.NextTiers[VisibilityAgents[Query]] = 1;
+			}
+		}
+	}
+
+	// Behaviours query the manager and add movement input so they are applied on the game thread
+	for (int32 i = 0; i < NumAgents; i++)
+	{
+		AEnemyCharacter* Agent = AllAgents[i];
+		if (!AgentData.DecisionDue[i])
+		{
+			if (!AgentData.AtCurrentNode[i] && !AgentData.MoveInputs[i].IsZero())
+			{
+				Agent->AddMovementInput(AgentData.MoveInputs[i]);
+			}
+			AgentsPerSignificanceTier[AgentData.SignificanceTiers[i]]++;
+			continue;
+		}
+
+		const int32 Tier = AgentData.NextTiers[i];
+		const float Interval = GetDecisionInterval(Tier);
+		if (Tier != AgentData.SignificanceTiers[i])
+		{
+			// Spread the decisions of agents that change tier together over the interval
+			AgentData.DecisionTimers[i] = Interval * FMath::FRandRange(0.5f, 1.0f);
+			AgentData.SignificanceTiers[i] = Tier;
+			Agent->GetCharacterMovement()->SetComponentTickInterval(Interval);
+		}
+		else
+		{
+			AgentData.DecisionTimers[i] = FMath::Max(AgentData.DecisionTimers[i] + Interval, 0.0f);
+		}
+		AgentsPerSignificanceTier[Tier]++;
+
+		Agent->UpdateAgent(AgentData.NextStates[i], AgentData.AtCurrentNode[i], AgentData.MoveInputs[i]);
 	}
 }
 
 void AAIManager::CreateAgents()
 {
-	if (AllNodes.Num() > 0)
+	if (NavigationGraph.Num() > 0)
 	{
 		for (int32 i = 0; i < NumAI; i++)
 		{
 			// Get a random node index
-			int32 NodeIndex = FMath::RandRange(0, AllNodes.Num() - 1);
-			AEnemyCharacter* SpawnedEnemy = GetWorld()->SpawnActor<AEnemyCharacter>(AgentToSpawn, AllNodes[NodeIndex]->GetActorLocation(), AllNodes[NodeIndex]->GetActorRotation());
+			int32 NodeIndex = FMath::RandRange(0, NavigationGraph.Num() - 1);
+			AEnemyCharacter* SpawnedEnemy = GetWorld()->SpawnActor<AEnemyCharacter>(AgentToSpawn, NavigationGraph.Positions[NodeIndex], FRotator::ZeroRotator);
 			SpawnedEnemy->Manager = this;
-			SpawnedEnemy->CurrentNode = AllNodes[NodeIndex];
+			SpawnedEnemy->CurrentNode = NodeIndex;
+			AddAgent(SpawnedEnemy);
 		}
 	}
 }
 
-ANavigationNode* AAIManager::FindNearestNode(const FVector& Location)
+int32 AAIManager::FindNearestNode(const FVector& Location)
+{
+	if (bNavigationGraphDirty)
+	{
+		RebuildNavigationGraph();
+	}
+
+	int32 NearestNode = NavigationSpatialIndex.FindNearest(NavigationGraph.Positions, Location);
+	UE_LOG(LogTemp, Verbose, TEXT("Nearest Node: %i"), NearestNode)
+	return NearestNode;
+}
+
+void AAIManager::BuildLandmarks()
+{
+	// Anything still being measured on a worker thread belongs to the old graph
+	LandmarkGraphVersion++;
+	bLandmarksDirty = false;
+
+	if (PathSearchMode != PathfindingMode::ASTAR_LANDMARKS)
+	{
+		Landmarks.Empty();
+		return;
+	}
+
+	// Generated graphs test the slope both ways so every edge has a matching edge back, node actors may be connected one way
+	Landmarks.Build(NavigationGraph, NumLandmarks, !bNavigationGraphFromActors, LandmarkSearchScratch);
+	MeasureLandmarkReduction();
+}
+
+void AAIManager::UpdateLandmarks(float DeltaTime)
 {
-	ANavigationNode* NearestNode = nullptr;
-	float NearestDistance = TNumericLimits<float>::Max();
-	//Loop through the nodes and find the nearest one in distance
-	for (ANavigationNode* CurrentNode : AllNodes)
+	if (PendingLandmarks.IsValid() && PendingLandmarks.IsReady())
 	{
-		float CurrentNodeDistance = FVector::Distance(Location, CurrentNode->GetActorLocation());
-		if (CurrentNodeDistance < NearestDistance)
+		TSharedPtr<FNavigationLandmarks, ESPMode::ThreadSafe> MeasuredLandmarks = PendingLandmarks.Get();
+		PendingLandmarks = TFuture<TSharedPtr<FNavigationLandmarks, ESPMode::ThreadSafe>>();
+		if (PendingLandmarkGraphVersion == LandmarkGraphVersion)
 		{
-			NearestDistance = CurrentNodeDistance;
-			NearestNode = CurrentNode;
+			Landmarks = MoveTemp(*MeasuredLandmarks);
+			bLandmarksDirty = false;
 		}
 	}
-	UE_LOG(LogTemp, Error, TEXT("Nearest Node: %s"), *NearestNode->GetName())
-		return NearestNode;
+
+	if (!bLandmarksDirty || PendingLandmarks.IsValid() || !Landmarks.IsBuilt())
+	{
+		return;
+	}
+	LandmarkUpdateDelay -= DeltaTime;
+	if (LandmarkUpdateDelay > 0.0f)
+	{
+		return;
+	}
+
+	// The worker measures a copy of the graph so the game thread can keep changing and searching the real one
+	PendingLandmarkGraphVersion = LandmarkGraphVersion;
+	PendingLandmarks = Async(EAsyncExecution::ThreadPool,
+		[Graph = NavigationGraph, MeasuredLandmarks = MakeShared<FNavigationLandmarks, ESPMode::ThreadSafe>(Landmarks)]()
+		{
+			TArray<FNavigationSearchScratch> Scratch;
+			MeasuredLandmarks->Update(Graph, Scratch);
+			return TSharedPtr<FNavigationLandmarks, ESPMode::ThreadSafe>(MeasuredLandmarks);
+		});
+}
+
+void AAIManager::MeasureLandmarkReduction()
+{
+	if (!Landmarks.IsBuilt())
+	{
+		return;
+	}
+
+	int64 EuclideanExpanded = 0;
+	int64 LandmarkExpanded = 0;
+	TArray<int32> Path;
+	for (int32 Query = 0; Query < SEARCH_COMPARISON_QUERIES; Query++)
+	{
+		const int32 StartNode = FMath::RandRange(0, NavigationGraph.Num() - 1);
+		const int32 EndNode = GetRandomConnectedNode(StartNode);
+		NavigationGraph.FindPath(StartNode, EndNode, SearchScratch, Path);
+		EuclideanExpanded += SearchScratch.NumExpanded;
+		NavigationGraph.FindPath(StartNode, EndNode, SearchScratch, Path, &Landmarks);
+		LandmarkExpanded += SearchScratch.NumExpanded;
+	}
+
+	LandmarkExpandedNodeReduction = EuclideanExpanded > 0 ? 100.0f * (1.0f - float(LandmarkExpanded) / float(EuclideanExpanded)) : 0.0f;
+	UE_LOG(LogTemp, Display, TEXT("%i landmarks: %lld nodes expanded against %lld with the straight line distance, %.1f%% fewer"),
+		Landmarks.Num(), LandmarkExpanded, EuclideanExpanded, LandmarkExpandedNodeReduction)
 }
 
-ANavigationNode* AAIManager::FindFurthestNode(const FVector& Location)
+void AAIManager::MeasureJumpPointReduction()
 {
-	ANavigationNode* FurthestNode = nullptr;
-	float FurthestDistance = 0.0f;
-	//Loop through the nodes and find the nearest one in distance
-	for (ANavigationNode* CurrentNode : AllNodes)
+	if (!JumpPointSearch.IsBuilt())
 	{
-		float CurrentNodeDistance = FVector::Distance(Location, CurrentNode->GetActorLocation());
-		if (CurrentNodeDistance > FurthestDistance)
+		return;
+	}
+
+	int64 AStarExpanded = 0;
+	int64 JumpPointExpanded = 0;
+	TArray<int32> Path;
+	for (int32 Query = 0; Query < SEARCH_COMPARISON_QUERIES; Query++)
+	{
+		const int32 StartNode = FMath::RandRange(0, NavigationGraph.Num() - 1);
+		const int32 EndNode = GetRandomConnectedNode(StartNode);
+		NavigationGraph.FindPath(StartNode, EndNode, SearchScratch, Path);
+		AStarExpanded += SearchScratch.NumExpanded;
+		JumpPointSearch.FindPath(NavigationGraph, StartNode, EndNode, SearchScratch, Path);
+		JumpPointExpanded += SearchScratch.NumExpanded;
+	}
+
+	JumpPointExpandedNodeReduction = AStarExpanded > 0 ? 100.0f * (1.0f - float(JumpPointExpanded) / float(AStarExpanded)) : 0.0f;
+	UE_LOG(LogTemp, Display, TEXT("Jump Point Search: %lld nodes expanded against %lld with A*, %.1f%% fewer"),
+		JumpPointExpanded, AStarExpanded, JumpPointExpandedNodeReduction)
+}
+
+void AAIManager::LabelComponents()
+{
+	const int32 NumComponents = NavigationGraph.LabelComponents(NodeComponents);
+
+	// Counting sort of the nodes by component
+	ComponentOffsets.Init(0, NumComponents + 1);
+	for (int32 Component : NodeComponents)
+	{
+		ComponentOffsets[Component + 1]++;
+	}
+	for (int32 Component = 0; Component < NumComponents; Component++)
+	{
+		ComponentOffsets[Component + 1] += ComponentOffsets[Component];
+	}
+	TArray<int32> Cursors(ComponentOffsets.GetData(), NumComponents);
+	ComponentNodes.SetNumUninitialized(NodeComponents.Num());
+	for (int32 Node = 0; Node < NodeComponents.Num(); Node++)
+	{
+		ComponentNodes[Cursors[NodeComponents[Node]]++] = Node;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Navigation graph has %i connected components"), NumComponents)
+}
+
+bool AAIManager::AreNodesAdjacent(int32 FromNode, int32 ToNode) const
+{
+	if (!NavigationGraph.IsValidNode(FromNode))
+	{
+		return false;
+	}
+	for (int32 Edge = NavigationGraph.EdgeOffsets[FromNode]; Edge < NavigationGraph.EdgeOffsets[FromNode + 1]; Edge++)
+	{
+		if (NavigationGraph.EdgeTargets[Edge] == ToNode)
 		{
-			FurthestDistance = CurrentNodeDistance;
-			FurthestNode = CurrentNode;
+			return true;
 		}
 	}
+	return false;
+}
+
+bool AAIManager::AreNodesConnected(int32 NodeA, int32 NodeB) const
+{
+	return NodeComponents.IsValidIndex(NodeA) && NodeComponents.IsValidIndex(NodeB) && NodeComponents[NodeA] == NodeComponents[NodeB];
+}
+
+int32 AAIManager::GetRandomConnectedNode(int32 FromNode) const
+{
+	if (!NodeComponents.IsValidIndex(FromNode))
+	{
+		return NavigationGraph.Num() > 0 ? FMath::RandRange(0, NavigationGraph.Num() - 1) : INDEX_NONE;
+	}
+	const int32 Component = NodeComponents[FromNode];
+	return ComponentNodes[FMath::RandRange(ComponentOffsets[Component], ComponentOffsets[Component + 1] - 1)];
+}
+
+int32 AAIManager::FindFurthestNode(const FVector& Location)
+{
+	if (bNavigationGraphDirty)
+	{
+		RebuildNavigationGraph();
+	}
 
-	UE_LOG(LogTemp, Error, TEXT("Furthest Node: %s"), *FurthestNode->GetName())
-		return FurthestNode;
+	int32 FurthestNode = NavigationSpatialIndex.FindFurthest(NavigationGraph.Positions, Location);
+	UE_LOG(LogTemp, Verbose, TEXT("Furthest Node: %i"), FurthestNode)
+	return FurthestNode;
 }
 
-void AAIManager::GenerateNodes(const TArray<FVector>& Vertices, int32 Width, int32 Height)
+void AAIManager::GenerateNodes(const FTerrainSnapshot& Terrain)
 {
+	const int32 Width = Terrain.GetGridWidth();
+	const int32 Height = Terrain.GetGridHeight();
+
 	// Destroy all the ANavigationNodes
 	for (TActorIterator<ANavigationNode> It(GetWorld()); It; ++It)
 	{
@@ -183,83 +946,310 @@ void AAIManager::GenerateNodes(const TArray<FVector>& Vertices, int32 Width, int
 	}
 	AllNodes.Empty();
 
-	// Go through all the vertices and place the nodes.
-	for (int i = 0; i < Vertices.Num(); i++)
+	// Build the connections straight from the vertices. Edge of the map vertices do not have all 8 connection directions.
+	TArray<FVector> Positions;
+	TArray<TArray<int32>> Adjacency;
+	Positions.SetNumUninitialized(Terrain.Num());
+	Adjacency.SetNum(Terrain.Num());
+	for (int32 Y = 0; Y < Height; Y++)
+	{
+		for (int32 X = 0; X < Width; X++)
+		{
+			Positions[Y * Width + X] = Terrain.GetVertex(X, Y);
+			GetAllowedGridNeighbours(Terrain, X, Y, Adjacency[Y * Width + X]);
+		}
+	}
+
+	NavigationGraph.Build(Positions, Adjacency);
+	OnGridGraphBuilt(Width, Height);
+}
+
+void AAIManager::SetNavigationGraph(const FNavigationGraph& Graph, int32 Width, int32 Height)
+{
+	check(Graph.Num() == Width * Height);
+
+	for (TActorIterator<ANavigationNode> It(GetWorld()); It; ++It)
 	{
-		ANavigationNode* NewNode = GetWorld()->SpawnActor<ANavigationNode>(Vertices[i], FRotator::ZeroRotator, FActorSpawnParameters());
-		AllNodes.Add(NewNode);
+		(*It)->Destroy();
 	}
+	AllNodes.Empty();
 
-	// Add the connections between the nodes excluding the edge of the map as they do not have all 8 connection directions.
-	for (int Y = 0; Y < Height; Y++)
+	NavigationGraph = Graph;
+	OnGridGraphBuilt(Width, Height);
+}
+
+void AAIManager::OnGridGraphBuilt(int32 Width, int32 Height)
+{
+	LabelComponents();
+	PathCache.Empty();
+	IntegrationFields.Empty();
+	NavigationSpatialIndex.BuildForGrid(NavigationGraph.Positions, Width, Height);
+	JumpPointSearch.Build(NavigationGraph, Width, Height);
+	if (PathSearchMode == PathfindingMode::JUMP_POINT_SEARCH)
 	{
-		for (int X = 0; X < Width; X++)
+		MeasureJumpPointReduction();
+	}
+	if (bUseHierarchicalPathfinding)
+	{
+		// Only the clusters whose nodes changed since the last generation are rebuilt
+		int32 NumRebuiltClusters = NavigationHierarchy.Build(NavigationGraph, Width, Height, HierarchicalClusterSize);
+		UE_LOG(LogTemp, Display, TEXT("Rebuilt %i navigation clusters"), NumRebuiltClusters)
+	}
+	else
+	{
+		NavigationHierarchy.Empty();
+	}
+	NavigationGridWidth = Width;
+	NavigationGridHeight = Height;
+	bNavigationGraphFromActors = false;
+	bNavigationGraphDirty = false;
+	BuildLandmarks();
+
+	if (bSpawnDebugNodes)
+	{
+		SpawnDebugNodes(Width, Height);
+	}
+}
+
+void AAIManager::UpdateNodes(const FTerrainSnapshot& Terrain, int32 MinX, int32 MinY, int32 MaxX, int32 MaxY)
+{
+	const int32 Width = Terrain.GetGridWidth();
+	const int32 Height = Terrain.GetGridHeight();
+	if (bNavigationGraphFromActors || NavigationGridWidth != Width || NavigationGridHeight != Height || NavigationGraph.Num() != Terrain.Num())
+	{
+		GenerateNodes(Terrain);
+		return;
+	}
+
+	MinX = FMath::Clamp(MinX, 0, Width - 1);
+	MinY = FMath::Clamp(MinY, 0, Height - 1);
+	MaxX = FMath::Clamp(MaxX, 0, Width - 1);
+	MaxY = FMath::Clamp(MaxY, 0, Height - 1);
+
+	TArray<int32> MovedNodes;
+	for (int32 Y = MinY; Y <= MaxY; Y++)
+	{
+		for (int32 X = MinX; X <= MaxX; X++)
 		{
-			// When does N occur? - When the Y is not at the top of the grid
-			if (!(Y == Height - 1))
-			{
-				AddConnection(AllNodes[Y * Width + X], AllNodes[(Y + 1) * Width + X]);
-			}
+			const int32 Node = Y * Width + X;
+			NavigationGraph.Positions[Node] = Terrain.GetVertex(X, Y);
+			MovedNodes.Add(Node);
+		}
+	}
 
-			// When does NE occur? - When the X or the Y is not on the right or top of the grid respectvely
-			if (!(Y == Height - 1 || X == 0))
-			{
-				AddConnection(AllNodes[Y * Width + X], AllNodes[(Y + 1) * Width + X - 1]);
-			}
+	// The slope and cost of every edge touching a moved node changes, so the nodes one step outside the region are tested too
+	const int32 OuterMinX = FMath::Max(MinX - 1, 0);
+	const int32 OuterMinY = FMath::Max(MinY - 1, 0);
+	const int32 OuterMaxX = FMath::Min(MaxX + 1, Width - 1);
+	const int32 OuterMaxY = FMath::Min(MaxY + 1, Height - 1);
+	TArray<int32> UpdatedNodes;
+	TArray<TArray<int32>> Adjacency;
+	for (int32 Y = OuterMinY; Y <= OuterMaxY; Y++)
+	{
+		for (int32 X = OuterMinX; X <= OuterMaxX; X++)
+		{
+			UpdatedNodes.Add(Y * Width + X);
+			GetAllowedGridNeighbours(Terrain, X, Y, Adjacency.AddDefaulted_GetRef());
+		}
+	}
+	NavigationGraph.UpdateNodes(UpdatedNodes, Adjacency);
+	// Removing or adding a single edge can split or join islands anywhere in the graph, which is the only time they are all labelled again
+	if (!CheckComponentsInRegion(OuterMinX, OuterMinY, OuterMaxX, OuterMaxY))
+	{
+		LabelComponents();
+	}
+	// Every cost from the landmarks may have changed. Measuring them is K searches over the whole graph, so it is left
+	// to a worker thread once the deformations stop and searches ignore the landmarks until then.
+	LandmarkGraphVersion++;
+	bLandmarksDirty = Landmarks.IsBuilt();
+	LandmarkUpdateDelay = LANDMARK_UPDATE_DELAY;
 
-			// When does E occur? - When the X is on the right of the grid.
-			if (!(X == 0))
-			{
-				AddConnection(AllNodes[Y * Width + X], AllNodes[Y * Width + X - 1]);
-			}
+	// Every changed edge touches a moved node, so only the routes through the region are dropped
+	auto IsMovedNode = [MinX, MinY, MaxX, MaxY, Width](int32 Node)
+	{
+		const int32 X = Node % Width;
+		const int32 Y = Node / Width;
+		return X >= MinX && X <= MaxX && Y >= MinY && Y <= MaxY;
+	};
+	PathCache.RemovePathsThrough(IsMovedNode);
 
-			// When does SE occur? - When the X or Y is not on the right or bottom of the grid respectively.
-			if (!(X == 0 || Y == 0))
+	// A route into the region has to cross the ring of nodes around it first, so a field stays exact for every node
+	// cheaper to reach than the cheapest node of that ring
+	for (TPair<TWeakObjectPtr<AActor>, FIntegrationField>& Pair : IntegrationFields)
+	{
+		FIntegrationField& Field = Pair.Value;
+		if (Field.Costs.Num() != NavigationGraph.Num())
+		{
+			continue;
+		}
+		float RingCost = IsMovedNode(Field.TargetNode) ? 0.0f : TNumericLimits<float>::Max();
+		for (int32 Y = OuterMinY; Y <= OuterMaxY; Y++)
+		{
+			for (int32 X = OuterMinX; X <= OuterMaxX; X++)
 			{
-				AddConnection(AllNodes[Y * Width + X], AllNodes[(Y - 1) * Width + X - 1]);
+				if (!IsMovedNode(Y * Width + X))
+				{
+					RingCost = FMath::Min(RingCost, Field.Costs[Y * Width + X]);
+				}
 			}
+		}
+		Field.ExactCost = FMath::Min(Field.ExactCost, RingCost);
+	}
+
+	NavigationSpatialIndex.UpdateHeights(NavigationGraph.Positions, MovedNodes);
+	JumpPointSearch.UpdateRegion(NavigationGraph, OuterMinX, OuterMinY, OuterMaxX, OuterMaxY);
+	if (NavigationHierarchy.IsBuilt())
+	{
+		int32 NumRebuiltClusters = NavigationHierarchy.UpdateRegion(NavigationGraph, OuterMinX, OuterMinY, OuterMaxX, OuterMaxY);
+		UE_LOG(LogTemp, Verbose, TEXT("Rebuilt %i navigation clusters"), NumRebuiltClusters)
+	}
+}
+
+bool AAIManager::CheckComponentsInRegion(int32 MinX, int32 MinY, int32 MaxX, int32 MaxY) const
+{
+	const int32 Width = NavigationGridWidth;
+	const int32 WindowMinX = FMath::Max(MinX - COMPONENT_CHECK_MARGIN, 0);
+	const int32 WindowMinY = FMath::Max(MinY - COMPONENT_CHECK_MARGIN, 0);
+	const int32 WindowMaxX = FMath::Min(MaxX + COMPONENT_CHECK_MARGIN, NavigationGridWidth - 1);
+	const int32 WindowMaxY = FMath::Min(MaxY + COMPONENT_CHECK_MARGIN, NavigationGridHeight - 1);
+	const int32 WindowWidth = WindowMaxX - WindowMinX + 1;
+	auto GetWindowIndex = [&](int32 Node)
+	{
+		const int32 X = Node % Width;
+		const int32 Y = Node / Width;
+		return X >= WindowMinX && X <= WindowMaxX && Y >= WindowMinY && Y <= WindowMaxY
+			? (Y - WindowMinY) * WindowWidth + (X - WindowMinX) : INDEX_NONE;
+	};
 
-			// When does S occur? - When the Y is not on the bottom of the grid.
-			if (!(Y == 0))
+	// Flood fill the window. Each piece has to hold nodes of a single old component and each old component has to be
+	// a single piece, then the changed edges neither joined nor split anything. Pieces only joined outside the window
+	// are treated as a split, which only costs a full labelling.
+	TArray<bool> Visited;
+	Visited.Init(false, WindowWidth * (WindowMaxY - WindowMinY + 1));
+	TSet<int32> VisitedComponents;
+	TArray<int32> Stack;
+	for (int32 Y = WindowMinY; Y <= WindowMaxY; Y++)
+	{
+		for (int32 X = WindowMinX; X <= WindowMaxX; X++)
+		{
+			const int32 StartNode = Y * Width + X;
+			if (Visited[GetWindowIndex(StartNode)])
 			{
-				AddConnection(AllNodes[Y * Width + X], AllNodes[(Y - 1) * Width + X]);
+				continue;
 			}
-
-			// When does SW occur? - When the X or Y is not on the left or bottom of the grid respectively.
-			if (!(X == Width - 1 || Y == 0))
+			const int32 Component = NodeComponents[StartNode];
+			bool bAlreadyVisited = false;
+			VisitedComponents.Add(Component, &bAlreadyVisited);
+			if (bAlreadyVisited)
 			{
-				AddConnection(AllNodes[Y * Width + X], AllNodes[(Y - 1) * Width + X + 1]);
+				return false;
 			}
 
-			// When does W occur? - When the X is not on the left of the grid.
-			if (!(X == Width - 1))
+			Visited[GetWindowIndex(StartNode)] = true;
+			Stack.Add(StartNode);
+			while (Stack.Num() > 0)
 			{
-				AddConnection(AllNodes[Y * Width + X], AllNodes[Y * Width + X + 1]);
+				const int32 Node = Stack.Pop(false);
+				for (int32 Edge = NavigationGraph.EdgeOffsets[Node]; Edge < NavigationGraph.EdgeOffsets[Node + 1]; Edge++)
+				{
+					const int32 Neighbour = NavigationGraph.EdgeTargets[Edge];
+					const int32 WindowIndex = GetWindowIndex(Neighbour);
+					if (WindowIndex == INDEX_NONE || Visited[WindowIndex]) continue;
+					if (NodeComponents[Neighbour] != Component)
+					{
+						return false;
+					}
+					Visited[WindowIndex] = true;
+					Stack.Add(Neighbour);
+				}
 			}
+		}
+	}
+	return true;
+}
 
-			// When does NW occur? - When the X or Y is not on the left or top of the grid.
-			if (!(X == Width - 1 || Y == Height - 1))
+void AAIManager::GetAllowedGridNeighbours(const FTerrainSnapshot& Terrain, int32 X, int32 Y, TArray<int32>& OutNeighbours) const
+{
+	const int32 Width = Terrain.GetGridWidth();
+	const int32 Height = Terrain.GetGridHeight();
+	// The 8 grid neighbours in the order N, NE, E, SE, S, SW, W, NW.
+	static const FIntPoint Directions[8] = {
+		FIntPoint(0, 1), FIntPoint(-1, 1), FIntPoint(-1, 0), FIntPoint(-1, -1),
+		FIntPoint(0, -1), FIntPoint(1, -1), FIntPoint(1, 0), FIntPoint(1, 1)
+	};
+
+	const FVector Vertex = Terrain.GetVertex(X, Y);
+	OutNeighbours.Reset(8);
+	for (const FIntPoint& Direction : Directions)
+	{
+		const int32 NeighbourX = X + Direction.X;
+		const int32 NeighbourY = Y + Direction.Y;
+		if (NeighbourX < 0 || NeighbourX >= Width || NeighbourY < 0 || NeighbourY >= Height) continue;
+
+		if (IsConnectionAllowed(Vertex, Terrain.GetVertex(NeighbourX, NeighbourY)))
+		{
+			OutNeighbours.Add(NeighbourY * Width + NeighbourX);
+		}
+	}
+}
+
+void AAIManager::SpawnDebugNodes(int32 Width, int32 Height)
+{
+	const int32 MinX = FMath::Clamp(DebugNodeAreaMin.X, 0, Width - 1);
+	const int32 MinY = FMath::Clamp(DebugNodeAreaMin.Y, 0, Height - 1);
+	const int32 MaxX = FMath::Clamp(DebugNodeAreaMax.X, 0, Width - 1);
+	const int32 MaxY = FMath::Clamp(DebugNodeAreaMax.Y, 0, Height - 1);
+
+	// Spawn a node actor for every vertex inside the selected area
+	TMap<int32, ANavigationNode*> DebugNodes;
+	for (int32 Y = MinY; Y <= MaxY; Y++)
+	{
+		for (int32 X = MinX; X <= MaxX; X++)
+		{
+			const int32 Node = Y * Width + X;
+			ANavigationNode* NewNode = GetWorld()->SpawnActor<ANavigationNode>(NavigationGraph.Positions[Node], FRotator::ZeroRotator, FActorSpawnParameters());
+			NewNode->NodeIndex = Node;
+			AllNodes.Add(NewNode);
+			DebugNodes.Add(Node, NewNode);
+		}
+	}
+
+	// Mirror the graph connections between the spawned nodes so they can be inspected in the editor
+	for (ANavigationNode* DebugNode : AllNodes)
+	{
+		const int32 Node = DebugNode->NodeIndex;
+		for (int32 Edge = NavigationGraph.EdgeOffsets[Node]; Edge < NavigationGraph.EdgeOffsets[Node + 1]; Edge++)
+		{
+			if (ANavigationNode** ConnectedNode = DebugNodes.Find(NavigationGraph.EdgeTargets[Edge]))
 			{
-				AddConnection(AllNodes[Y * Width + X], AllNodes[(Y + 1) * Width + X + 1]);
+				DebugNode->ConnectedNodes.Add(*ConnectedNode);
 			}
 		}
 	}
-
 }
 
 void AAIManager::AddConnection(ANavigationNode* FromNode, ANavigationNode* ToNode)
 {
-	FVector DirectionVector = ToNode->GetActorLocation() - FromNode->GetActorLocation();
-	DirectionVector.Normalize();
-	if (FMath::Abs(DirectionVector.Z) < AllowedAngle)
+	if (IsConnectionAllowed(FromNode->GetActorLocation(), ToNode->GetActorLocation()))
 	{
 		if (!FromNode->ConnectedNodes.Contains(ToNode))
 			FromNode->ConnectedNodes.Add(ToNode);
 
 		if (!ToNode->ConnectedNodes.Contains(FromNode))
 			ToNode->ConnectedNodes.Add(FromNode);
+
+		// Only graphs built from node actors follow their connections, generated graphs ignore debug node edits.
+		if (bNavigationGraphFromActors)
+		{
+			bNavigationGraphDirty = true;
+			PathCache.Empty();
+		}
 	}
 }
 
-
-
+bool AAIManager::IsConnectionAllowed(const FVector& From, const FVector& To) const
+{
+	FVector DirectionVector = To - From;
+	DirectionVector.Normalize();
+	return FMath::Abs(DirectionVector.Z) < AllowedAngle;
+}
@@ -4,8 +4,34 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "NavigationGraph.h"
+#include "NavigationSpatialIndex.h"
+#include "NavigationJumpPointSearch.h"
+#include "NavigationHierarchy.h"
+#include "NavigationPathCache.h"
+#include "NavigationLandmarks.h"
+#include "TerrainSnapshot.h"
+#include "Async/Future.h"
 #include "AIManager.generated.h"
 
+UENUM()
+enum class PathfindingMode : uint8
+{
+	ASTAR,
+	// A* with the landmark heuristic, far fewer nodes are expanded when slopes force long detours.
+	ASTAR_LANDMARKS,
+	// Only used on graphs generated from a grid by GenerateNodes, other graphs always use A*.
+	JUMP_POINT_SEARCH
+};
+
+enum class AgentState : uint8;
+
+// Called on the game thread with the result of an asynchronous path query. The path is empty if no path exists.
+DECLARE_DELEGATE_OneParam(FPathQueryDelegate, const TArray<int32>&);
+// Called with the result of a hierarchical path query. bIsFullPath is set when the hierarchy could not answer and the
+// result is a full path of grid nodes rather than a list of waypoints.
+DECLARE_DELEGATE_TwoParams(FHierarchicalPathQueryDelegate, const TArray<int32>&, bool);
+
 UCLASS()
 class ADVGAMESPROGRAMMING_API AAIManager : public AActor
 {
@@ -29,33 +55,382 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Agents")
 	TSubclassOf<AEnemyCharacter> AgentToSpawn;
 
+	// Works out the next state and movement of every agent in parallel on the worker threads before applying them.
+	UPROPERTY(EditAnywhere, Category = "Agents")
+	bool bUpdateAgentsOnWorkerThreads;
+
+	// Agents far from every player decide less often and their movement ticks in coarser steps. Each tier starts this
+	// far beyond the previous one. Agents fighting or watching an actor always use the first tier and agents in a
+	// player's line of sight never go beyond the second.
+	UPROPERTY(EditAnywhere, Category = "Significance", meta = (ClampMin = "0.0"))
+	float SignificanceDistance;
+	// The time in seconds between decisions for each significance tier, the first tier should be zero so agents near
+	// players update every frame.
+	UPROPERTY(EditAnywhere, Category = "Significance")
+	TArray<float> SignificanceDecisionIntervals;
+	// How many agents were in each significance tier on the last update.
+	UPROPERTY(VisibleAnywhere, Category = "Significance")
+	TArray<int32> AgentsPerSignificanceTier;
+
+	// On generated maps the manager works out which agents can see which players in one batched pass against the
+	// terrain instead of every agent running its own perception component.
+	UPROPERTY(EditAnywhere, Category = "Perception")
+	bool bUseBatchedPerception;
+	// How close a player has to be for an agent to notice it.
+	UPROPERTY(EditAnywhere, Category = "Perception", meta = (ClampMin = "0.0", EditCondition = "bUseBatchedPerception"))
+	float PerceptionSightRadius;
+	// How far a player an agent is already watching can get before it is lost.
+	UPROPERTY(EditAnywhere, Category = "Perception", meta = (ClampMin = "0.0", EditCondition = "bUseBatchedPerception"))
+	float PerceptionLoseSightRadius;
+	// The angle in degrees either side of an agent's forward direction it can notice players in.
+	UPROPERTY(EditAnywhere, Category = "Perception", meta = (ClampMin = "0.0", ClampMax = "180.0", EditCondition = "bUseBatchedPerception"))
+	float PerceptionPeripheralVisionAngle;
+	// The number of agents whose sight is checked each frame, the rest are checked on the following frames.
+	UPROPERTY(EditAnywhere, Category = "Perception", meta = (ClampMin = "1", EditCondition = "bUseBatchedPerception"))
+	int32 PerceptionChecksPerFrame;
+	// Spreads the batched line of sight tests for perception and clear shots over the worker threads.
+	UPROPERTY(EditAnywhere, Category = "Perception")
+	bool bRunLineOfSightOnWorkerThreads;
+
 	UPROPERTY(EditAnywhere)
 	float AllowedAngle;
 
+	UPROPERTY(EditAnywhere, Category = "Path Queries")
+	PathfindingMode PathSearchMode;
+	// The number of landmarks measured for the ASTAR_LANDMARKS search mode, each one costs a Dijkstra search
+	// whenever the graph changes and two bytes per node.
+	UPROPERTY(EditAnywhere, Category = "Path Queries", meta = (ClampMin = "1", ClampMax = "32"))
+	int32 NumLandmarks;
+	// How many fewer nodes Jump Point Search expanded than A*, as a percentage, over a sample of random queries run
+	// when the graph was built.
+	UPROPERTY(VisibleAnywhere, Category = "Path Queries")
+	float JumpPointExpandedNodeReduction;
+	// How many fewer nodes the landmark heuristic expanded than the straight line distance, as a percentage, over a
+	// sample of random queries run when the landmarks were built.
+	UPROPERTY(VisibleAnywhere, Category = "Path Queries")
+	float LandmarkExpandedNodeReduction;
+	// Builds a clustered abstraction of generated maps so long patrol routes are planned on the cluster entrances
+	// and only turned into nodes one leg at a time.
+	UPROPERTY(EditAnywhere, Category = "Path Queries")
+	bool bUseHierarchicalPathfinding;
+	UPROPERTY(EditAnywhere, Category = "Path Queries", meta = (ClampMin = "4", EditCondition = "bUseHierarchicalPathfinding"))
+	int32 HierarchicalClusterSize;
+
+	// Generated maps build their navigation graph without spawning node actors. When enabled, node actors are
+	// spawned for the grid vertices between DebugNodeAreaMin and DebugNodeAreaMax so that area can be inspected.
+	UPROPERTY(EditAnywhere, Category = "Navigation Nodes")
+	bool bSpawnDebugNodes;
+	UPROPERTY(EditAnywhere, Category = "Navigation Nodes", meta = (EditCondition = "bSpawnDebugNodes"))
+	FIntPoint DebugNodeAreaMin;
+	UPROPERTY(EditAnywhere, Category = "Navigation Nodes", meta = (EditCondition = "bSpawnDebugNodes"))
+	FIntPoint DebugNodeAreaMax;
+
+	// The time in milliseconds the manager can spend on queued path queries each frame. At least one query is always run.
+	UPROPERTY(EditAnywhere, Category = "Path Queries", meta = (ClampMin = "0.0"))
+	float PathQueryBudgetMs;
+	// Runs queued path queries in parallel batches on the worker threads instead of one at a time on the game thread.
+	UPROPERTY(EditAnywhere, Category = "Path Queries")
+	bool bRunPathQueriesOnWorkerThreads;
+
+	// The number of paths kept by the path cache. Zero disables the cache.
+	UPROPERTY(EditAnywhere, Category = "Path Cache", meta = (ClampMin = "0"))
+	int32 PathCacheCapacity;
+	// Queries answered with a cached path that had the same start and end node.
+	UPROPERTY(VisibleAnywhere, Category = "Path Cache")
+	int32 PathCacheHits;
+	// Queries answered with the remainder of a cached path that passed through the start node.
+	UPROPERTY(VisibleAnywhere, Category = "Path Cache")
+	int32 PathCacheSuffixHits;
+	UPROPERTY(VisibleAnywhere, Category = "Path Cache")
+	int32 PathCacheMisses;
+
+	// Agents that engage or evade a target follow a shared Dijkstra map from the target instead of searching for their own path.
+	UPROPERTY(EditAnywhere, Category = "Path Queries")
+	bool bUseIntegrationFields;
+
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
-	TArray<ANavigationNode*> GeneratePath(ANavigationNode* StartNode, ANavigationNode* EndNode);
+	/**
+	Finds a path between two nodes of the navigation graph.
+	@param StartNode - The graph index of the node to start from.
+	@param EndNode - The graph index of the node to reach.
+	@return Path - The node indices from the end node back towards the start node, excluding the start node. Empty if no path exists.
+	*/
+	TArray<int32> GeneratePath(int32 StartNode, int32 EndNode);
+	/**
+	Queues a path query that is run within the per frame path query budget.
+	@param StartNode - The graph index of the node to start from.
+	@param EndNode - The graph index of the node to reach.
+	@param OnComplete - Called with the path, in the same format as GeneratePath, once the query has run.
+	@return Handle - Identifies the query so that it can be cancelled.
+	*/
+	int32 RequestPath(int32 StartNode, int32 EndNode, const FPathQueryDelegate& OnComplete);
+	// Queues GenerateHierarchicalPath to run within the path query budget, OnComplete is called with the waypoints
+	// or with a full path when the hierarchy could not find a route.
+	int32 RequestHierarchicalPath(int32 StartNode, int32 EndNode, const FHierarchicalPathQueryDelegate& OnComplete);
+	// Queues RefinePathSegment to run within the path query budget, OnComplete is called with the nodes of the leg.
+	int32 RequestPathSegment(int32 FromNode, int32 ToNode, const FPathQueryDelegate& OnComplete);
+	void CancelPathQuery(int32 Handle);
+
+	/**
+	Finds the next node to move to from the integration field of a target. The field is rebuilt the first time
+	it is used after the target moves to a different nearest node, so all agents share one search per move.
+	@param Target - The actor the field is built around.
+	@param FromNode - The node the agent is at.
+	@param bTowardsTarget - Whether to move down the field towards the target or up it away from the target.
+	@return NextNode - The neighbouring node to move to, or INDEX_NONE if no neighbour improves on the current node.
+	*/
+	int32 GetIntegrationFieldStep(AActor* Target, int32 FromNode, bool bTowardsTarget);
+
+	bool CanUseHierarchicalPath() const { return bUseHierarchicalPathfinding && NavigationHierarchy.IsBuilt(); }
+	/**
+	Plans a route over the cluster entrances without working out the nodes in between.
+	@return Waypoints - The route in the same format as GeneratePath. Each leg is turned into nodes with RefinePathSegment.
+	*/
+	TArray<int32> GenerateHierarchicalPath(int32 StartNode, int32 EndNode);
+	/**
+	Finds the nodes between two consecutive waypoints of a hierarchical route.
+	@return Path - The nodes in the same format as GeneratePath.
+	*/
+	TArray<int32> RefinePathSegment(int32 FromNode, int32 ToNode);
 	void PopulateNodes();
 	void CreateAgents();
 
 	/**
 	Finds the nearest navigation node from the given location.
 	@param Location - The location that you want to find the nearest node from.
-	@return NearestNode - The nearest node to the given location.
+	@return NearestNode - The graph index of the nearest node to the given location.
 	*/
-	ANavigationNode* FindNearestNode(const FVector& Location);
+	int32 FindNearestNode(const FVector& Location);
 	/**
 	Finds the furthest navigation node from the given location.
 	@param Location - The location that you want to find the furthest node from.
-	@return FurthestNode - The furthest node from the given location.
+	@return FurthestNode - The graph index of the furthest node from the given location.
 	*/
-	ANavigationNode* FindFurthestNode(const FVector& Location);
+	int32 FindFurthestNode(const FVector& Location);
 
-	void GenerateNodes(const TArray<FVector>& Vertices, int32 Width, int32 Height);
+	/**
+	Builds the navigation graph straight from the grid of vertices of a generated terrain.
+	No node actors are spawned unless bSpawnDebugNodes is set.
+	*/
+	void GenerateNodes(const FTerrainSnapshot& Terrain);
+	/**
+	Uses a navigation graph that was already generated from a Width x Height grid of vertices, such as one loaded
+	from the terrain cache, instead of testing every connection again.
+	*/
+	void SetNavigationGraph(const FNavigationGraph& Graph, int32 Width, int32 Height);
+	/**
+	Updates the navigation graph after the heights of the vertices inside a region of the grid have changed.
+	Only the connections of the nodes in and around the region are tested again. Falls back to GenerateNodes
+	if the graph was not generated from a grid of the same size.
+	@param Terrain - The terrain including the changed heights.
+	@param MinX, MinY, MaxX, MaxY - The inclusive grid coordinates of the changed region.
+	*/
+	void UpdateNodes(const FTerrainSnapshot& Terrain, int32 MinX, int32 MinY, int32 MaxX, int32 MaxY);
 	void AddConnection(ANavigationNode* FromNode, ANavigationNode* ToNode);
+	bool IsConnectionAllowed(const FVector& From, const FVector& To) const;
+
+	/**
+	Tests whether the terrain of the map this manager belongs to blocks the view between two locations.
+	@return Whether the view is clear, always true when the manager has no procedural map.
+	*/
+	bool HasLineOfSight(const FVector& From, const FVector& To) const;
+
+	// Whether a path between two nodes could exist. Nodes on different islands of the graph are rejected without a search.
+	bool AreNodesConnected(int32 NodeA, int32 NodeB) const;
+	/**
+	Picks a random node that can be reached from the given node.
+	@return A node in the same connected component, or a random node from the whole graph when FromNode is not valid.
+	*/
+	int32 GetRandomConnectedNode(int32 FromNode) const;
+
+	// Whether the navigation graph has an edge from one node to the other.
+	bool AreNodesAdjacent(int32 FromNode, int32 ToNode) const;
+	FVector GetNodeLocation(int32 Node) const { return NavigationGraph.Positions[Node]; }
+	int32 GetNumNodes() const { return NavigationGraph.Num(); }
+
+	/**
+	Rebuilds the compact navigation graph from AllNodes and their ConnectedNodes.
+	Called automatically before a search when the node connections have changed.
+	*/
+	void RebuildNavigationGraph();
+	const FNavigationGraph& GetNavigationGraph() const { return NavigationGraph; }
 
 private:
 
-	TArray<ANavigationNode*> ReconstructPath(ANavigationNode* StartNode, ANavigationNode* EndNode);
+	// The procedural map that owns this manager, or nullptr when the level uses hand placed nodes.
+	class AProcedurallyGeneratedMap* ProceduralMap;
+	FNavigationGraph NavigationGraph;
+	FNavigationSpatialIndex NavigationSpatialIndex;
+	FNavigationJumpPointSearch JumpPointSearch;
+	FNavigationHierarchy NavigationHierarchy;
+	// Search working memory for the abstract graph of the hierarchy.
+	FNavigationSearchScratch HierarchySearchScratch;
+	// Dimensions of the vertex grid the graph was generated from, zero for graphs built from node actors.
+	int32 NavigationGridWidth;
+	int32 NavigationGridHeight;
+	// Search working memory for queries made on the game thread.
+	FNavigationSearchScratch SearchScratch;
+	// Whether the graph was built from the node actors in AllNodes rather than from generated vertices.
+	bool bNavigationGraphFromActors;
+	bool bNavigationGraphDirty;
+
+	// The connected component of each node of the navigation graph.
+	TArray<int32> NodeComponents;
+	// The nodes grouped by component, the nodes of component C are ComponentNodes[ComponentOffsets[C]] up to
+	// ComponentNodes[ComponentOffsets[C + 1] - 1].
+	TArray<int32> ComponentOffsets;
+	TArray<int32> ComponentNodes;
+
+	FNavigationLandmarks Landmarks;
+	// Search working memory for the landmark searches, one per landmark.
+	TArray<FNavigationSearchScratch> LandmarkSearchScratch;
+	// Set when the edges changed after the landmark costs were measured. Searches fall back to the straight line
+	// heuristic until the costs are measured again, as the stale bounds could overestimate.
+	bool bLandmarksDirty;
+	// Seconds left before dirty landmarks are measured again, restarted by every change so a burst of deformations is measured once.
+	float LandmarkUpdateDelay;
+	const float LANDMARK_UPDATE_DELAY = 1.0f;
+	// Counts the changes to the graph, landmarks measured on a copy of an older graph are thrown away.
+	int32 LandmarkGraphVersion;
+	int32 PendingLandmarkGraphVersion;
+	// The landmarks being measured again on a worker thread.
+	TFuture<TSharedPtr<FNavigationLandmarks, ESPMode::ThreadSafe>> PendingLandmarks;
+	// The number of random queries a search is compared with plain A* on.
+	const int32 SEARCH_COMPARISON_QUERIES = 32;
+
+	// Builds the landmarks when the search mode uses them, called whenever the graph is built.
+	void BuildLandmarks();
+	// Swaps in landmarks measured on a worker thread and starts measuring dirty landmarks once the graph has settled.
+	void UpdateLandmarks(float DeltaTime);
+	// Compares the nodes expanded with and without the landmarks and updates LandmarkExpandedNodeReduction.
+	void MeasureLandmarkReduction();
+	// Compares the nodes expanded by Jump Point Search and A* and updates JumpPointExpandedNodeReduction.
+	void MeasureJumpPointReduction();
+
+	// Labels the connected components, called whenever the edges of the navigation graph change.
+	void LabelComponents();
+	/**
+	Checks the components around a changed region of the grid graph without labelling the whole graph. Only works
+	when the change neither joined nor split components, which is the usual case.
+	@param MinX, MinY, MaxX, MaxY - The inclusive grid coordinates of the nodes whose edges changed.
+	@return Whether the labels are still right, otherwise the whole graph has to be labelled again.
+	*/
+	bool CheckComponentsInRegion(int32 MinX, int32 MinY, int32 MaxX, int32 MaxY) const;
+	// How far past a changed region the components are followed to see whether they are still in one piece.
+	const int32 COMPONENT_CHECK_MARGIN = 4;
+	void SpawnDebugNodes(int32 Width, int32 Height);
+	// Builds everything derived from a graph generated from a grid, the search structures and the debug nodes.
+	void OnGridGraphBuilt(int32 Width, int32 Height);
+	// Fills OutNeighbours with the grid neighbours of the vertex at (X, Y) that pass the slope test.
+	void GetAllowedGridNeighbours(const FTerrainSnapshot& Terrain, int32 X, int32 Y, TArray<int32>& OutNeighbours) const;
+
+	FNavigationPathCache PathCache;
+
+	// Travel costs from the nearest node of a target to every node in the graph.
+	struct FIntegrationField
+	{
+		int32 TargetNode;
+		TArray<float> Costs;
+		// Costs below this are still exact after changes to the graph, costs at or above it may be stale.
+		float ExactCost = TNumericLimits<float>::Max();
+	};
+
+	TMap<TWeakObjectPtr<AActor>, FIntegrationField> IntegrationFields;
+
+	// Looks the path up in the path cache and updates the hit and miss counters.
+	bool FindCachedPath(int32 StartNode, int32 EndNode, TArray<int32>& OutPath);
+
+	// Runs the search selected by PathSearchMode. Safe to call from several threads with different scratch.
+	bool FindPath(int32 StartNode, int32 EndNode, FNavigationSearchScratch& Scratch, TArray<int32>& OutPath) const;
+
+	enum class EPathQueryType : uint8
+	{
+		Full,
+		Hierarchical,
+		Segment
+	};
+
+	struct FPathQuery
+	{
+		EPathQueryType Type;
+		int32 Handle;
+		int32 StartNode;
+		int32 EndNode;
+		FPathQueryDelegate OnComplete;
+		FHierarchicalPathQueryDelegate OnHierarchicalComplete;
+		TArray<int32> Path;
+		bool bFromCache;
+		// Whether Path holds every node of the route, which is also the case when a hierarchical query fell back.
+		bool bFullPath;
+	};
+
+	TArray<FPathQuery> PendingPathQueries;
+	int32 NextPathQueryHandle;
+	// One search scratch per query in a worker thread batch so concurrent searches never share state.
+	TArray<FNavigationSearchScratch> WorkerSearchScratch;
+	// Search working memory for the abstract graph, one per query in a worker thread batch.
+	TArray<FNavigationSearchScratch> WorkerHierarchyScratch;
+
+	// Adds a query to the queue, the caller binds the callback for its type.
+	FPathQuery& QueuePathQuery(EPathQueryType Type, int32 StartNode, int32 EndNode);
+	// Runs one queued query. Safe to call from several threads with different scratch.
+	void RunPathQuery(FPathQuery& Query, FNavigationSearchScratch& Scratch, FNavigationSearchScratch& HierarchyScratch) const;
+
+	void ProcessPathQueries();
+
+	// What the batched agent update reads and works out for each agent, stored as one array per field with an
+	// entry per agent in AllAgents. The arrays are kept between frames so they are only reallocated when agents are added.
+	struct FAgentUpdateData
+	{
+		TArray<AgentState> States;
+		TArray<int32> CurrentNodes;
+		TArray<float> HealthFractions;
+		TArray<float> NodeAccuracies;
+		TArray<FVector> Locations;
+		TArray<bool> CanSee;
+
+		TArray<AgentState> NextStates;
+		TArray<bool> AtCurrentNode;
+		TArray<FVector> MoveInputs;
+		// Whether the agent makes a decision this frame rather than only carrying on towards its current node.
+		TArray<bool> DecisionDue;
+		TArray<int32> NextTiers;
+
+		// Carried over between frames.
+		TArray<int32> SignificanceTiers;
+		TArray<float> DecisionTimers;
+
+		void SetNum(int32 Num);
+	};
+
+	FAgentUpdateData AgentData;
+	// Significance tiers are only lowered once an agent is this much further out than the boundary so they do not flicker.
+	const float SIGNIFICANCE_HYSTERESIS = 500.0f;
+
+	// The agent the next perception pass starts from.
+	int32 PerceptionCursor;
+
+	bool IsUsingBatchedPerception() const { return bUseBatchedPerception && ProceduralMap; }
+	/**
+	Works out what the next PerceptionChecksPerFrame agents can see. Players are put in a grid of cells as large as
+	the lose sight radius so each agent only looks at the players in the cells around it, the remaining candidates
+	are tested against the terrain in one batch and the results are written to the agents together.
+	*/
+	void UpdatePerception();
+
+	// Adds an agent to AllAgents and takes over its update.
+	void AddAgent(AEnemyCharacter* Agent);
+	// Removes agents that have been destroyed along with their carried over update data.
+	void RemoveDestroyedAgents();
+	/**
+	Updates every agent in AllAgents. Their state is gathered into AgentData, the transitions and movement are worked
+	out for all of them in one pass, then each agent applies its result. Agents that are not due a decision this
+	frame only keep moving towards their current node.
+	*/
+	void UpdateAgents(float DeltaTime);
+	int32 GetSignificanceTierForDistance(float Distance) const;
+	float GetDecisionInterval(int32 Tier) const;
+
 };
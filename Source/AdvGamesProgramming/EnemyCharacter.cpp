@@ -3,11 +3,16 @@
 
 #include "EnemyCharacter.h"
 #include "AIManager.h"
-#include "NavigationNode.h"
 #include "GameFramework/CharacterMovementComponent.h"
 #include "Perception/AIPerceptionComponent.h"
 #include "HealthComponent.h"
 
+namespace
+{
+	// Agents that see an actor with less health than this fraction evade it rather than engage it.
+	const float EVADE_HEALTH_FRACTION = 0.4f;
+}
+
 // Sets default values
 AEnemyCharacter::AEnemyCharacter()
 {
@@ -16,6 +21,11 @@ AEnemyCharacter::AEnemyCharacter()
 
 	CurrentAgentState = AgentState::PATROL;
 	PathfindingNodeAccuracy = 100.0f;
+	CurrentNode = INDEX_NONE;
+	PathQueryHandle = INDEX_NONE;
+	PathQueryGoal = INDEX_NONE;
+	bRepathRequested = false;
+	bPerceptionFromManager = false;
 }
 
 // Called when the game starts or when spawned
@@ -28,7 +38,11 @@ void AEnemyCharacter::BeginPlay()
 	HealthComponent = FindComponentByClass<UHealthComponent>();
 
 	PerceptionComponent = FindComponentByClass<UAIPerceptionComponent>();
-	if (PerceptionComponent)
+	if (PerceptionComponent && bPerceptionFromManager)
+	{
+		PerceptionComponent->UnregisterComponent();
+	}
+	else if (PerceptionComponent)
 	{
 		PerceptionComponent->OnTargetPerceptionUpdated.AddDynamic(this, &AEnemyCharacter::SensePlayer);
 	}
@@ -43,48 +57,76 @@ void AEnemyCharacter::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-	if (CurrentAgentState == AgentState::PATROL)
+	const bool bHasNode = Manager && CurrentNode != INDEX_NONE;
+	const FVector MoveInput = bHasNode ? Manager->GetNodeLocation(CurrentNode) - GetActorLocation() : FVector::ZeroVector;
+	UpdateAgent(GetNextState(CurrentAgentState, bCanSeeActor, GetHealthFraction()), bHasNode && MoveInput.IsNearlyZero(PathfindingNodeAccuracy), MoveInput);
+}
+
+AgentState AEnemyCharacter::GetNextState(AgentState State, bool bCanSee, float HealthFraction)
+{
+	if (State == AgentState::PATROL)
 	{
-		AgentPatrol();
-		if (bCanSeeActor && HealthComponent->HealthPercentageRemaining() >= 40.0f)
+		if (bCanSee)
 		{
-			CurrentAgentState = AgentState::ENGAGE;
-			Path.Empty();
-		} 
-		else if (bCanSeeActor && HealthComponent->HealthPercentageRemaining() < 40.0f)
-		{
-			CurrentAgentState = AgentState::EVADE;
-			Path.Empty();
+			return HealthFraction >= EVADE_HEALTH_FRACTION ? AgentState::ENGAGE : AgentState::EVADE;
 		}
 	}
+	else if (!bCanSee)
+	{
+		return AgentState::PATROL;
+	}
+	else if (State == AgentState::ENGAGE && HealthFraction < EVADE_HEALTH_FRACTION)
+	{
+		return AgentState::EVADE;
+	}
+	else if (State == AgentState::EVADE && HealthFraction >= EVADE_HEALTH_FRACTION)
+	{
+		return AgentState::ENGAGE;
+	}
+	return State;
+}
+
+void AEnemyCharacter::UpdateAgent(AgentState NextState, bool bAtCurrentNode, const FVector& MoveInput)
+{
+	if (CurrentAgentState == AgentState::PATROL)
+	{
+		AgentPatrol();
+	}
 	else if (CurrentAgentState == AgentState::ENGAGE)
 	{
 		AgentEngage();
-		if (!bCanSeeActor)
-		{
-			CurrentAgentState = AgentState::PATROL;
-		}
-		else if (bCanSeeActor && HealthComponent->HealthPercentageRemaining() < 40.0f)
-		{
-			CurrentAgentState = AgentState::EVADE;
-			Path.Empty();
-		}
 	}
 	else if (CurrentAgentState == AgentState::EVADE)
 	{
 		AgentEvade();
-		if (!bCanSeeActor)
+	}
+
+	if (NextState != CurrentAgentState)
+	{
+		CurrentAgentState = NextState;
+		// Patrolling carries on along the current path, the other states need a path for their new target
+		if (NextState != AgentState::PATROL)
 		{
-			CurrentAgentState = AgentState::PATROL;
+			RequestRepath();
 		}
-		else if (bCanSeeActor && HealthComponent->HealthPercentageRemaining() >= 40.0f)
+	}
+
+	if (bAtCurrentNode)
+	{
+		if (Path.Num() > 0)
 		{
-			CurrentAgentState = AgentState::ENGAGE;
-			Path.Empty();
+			CurrentNode = Path.Pop();
 		}
 	}
+	else if (!MoveInput.IsZero())
+	{
+		AddMovementInput(MoveInput);
+	}
+}
 
-	MoveAlongPath();
+float AEnemyCharacter::GetHealthFraction() const
+{
+	return HealthComponent ? HealthComponent->CurrentHealth / HealthComponent->MaxHealth : 1.0f;
 }
 
 // Called to bind functionality to input
@@ -96,40 +138,64 @@ void AEnemyCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInputComp
 
 void AEnemyCharacter::AgentPatrol()
 {
-	if (Path.Num() == 0)
+	if (Path.Num() == 0 && PatrolWaypoints.Num() > 0 && !bRepathRequested)
+	{
+		// Work out the nodes for the next leg of the route only when the agent is about to walk it
+		if (PathQueryHandle == INDEX_NONE)
+		{
+			PathQueryGoal = PatrolWaypoints.Pop();
+			PathQueryHandle = Manager->RequestPathSegment(CurrentNode, PathQueryGoal, FPathQueryDelegate::CreateUObject(this, &AEnemyCharacter::OnPathSegmentGenerated));
+		}
+	}
+	else if (NeedsNewPath())
 	{
-		if (Manager)
+		// Only pick goals on the agent's own island of the graph so every patrol has a route
+		int32 PatrolGoal = Manager->GetRandomConnectedNode(CurrentNode);
+		if (Manager->CanUseHierarchicalPath())
 		{
-			Path = Manager->GeneratePath(CurrentNode, Manager->AllNodes[FMath::RandRange(0, Manager->AllNodes.Num() - 1)]);
+			PathQueryGoal = PatrolGoal;
+			PathQueryHandle = Manager->RequestHierarchicalPath(CurrentNode, PatrolGoal, FHierarchicalPathQueryDelegate::CreateUObject(this, &AEnemyCharacter::OnPatrolRouteGenerated));
+		}
+		else
+		{
+			RequestPathTo(PatrolGoal);
 		}
 	}
 }
 
 void AEnemyCharacter::AgentEngage()
 {
-	if (bCanSeeActor && DetectedActor)
+	if (bCanSeeActor && DetectedActor && HasClearShot())
 	{
 		FVector FireDirection = DetectedActor->GetActorLocation() - GetActorLocation();
 		Fire(FireDirection);
 	}
-	if (Path.Num() == 0 && DetectedActor)
+	if (Manager && Manager->bUseIntegrationFields)
+	{
+		FollowIntegrationField(true);
+	}
+	else if (NeedsNewPath() && DetectedActor)
 	{
-		ANavigationNode* NearestNode = Manager->FindNearestNode(DetectedActor->GetActorLocation());
-		Path = Manager->GeneratePath(CurrentNode, NearestNode);
+		int32 NearestNode = Manager->FindNearestNode(DetectedActor->GetActorLocation());
+		RequestPathTo(NearestNode);
 	}
 }
 
 void AEnemyCharacter::AgentEvade()
 {
-	if (bCanSeeActor && DetectedActor)
+	if (bCanSeeActor && DetectedActor && HasClearShot())
 	{
 		FVector FireDirection = DetectedActor->GetActorLocation() - GetActorLocation();
 		Fire(FireDirection);
 	}
-	if (Path.Num() == 0 && DetectedActor)
+	if (Manager && Manager->bUseIntegrationFields)
+	{
+		FollowIntegrationField(false);
+	}
+	else if (NeedsNewPath() && DetectedActor)
 	{
-		ANavigationNode* FurthestNode = Manager->FindFurthestNode(DetectedActor->GetActorLocation());
-		Path = Manager->GeneratePath(CurrentNode, FurthestNode);
+		int32 FurthestNode = Manager->FindFurthestNode(DetectedActor->GetActorLocation());
+		RequestPathTo(FurthestNode);
 	}
 }
 
@@ -137,27 +203,110 @@ void AEnemyCharacter::SensePlayer(AActor* ActorSensed, FAIStimulus Stimulus)
 {
 	if (Stimulus.WasSuccessfullySensed())
 	{
-		UE_LOG(LogTemp, Warning, TEXT("Player Detected"))
+		UE_LOG(LogTemp, Verbose, TEXT("Player Detected"))
 		DetectedActor = ActorSensed;
 		bCanSeeActor = true;
 	}
 	else
 	{
-		UE_LOG(LogTemp, Warning, TEXT("Player Lost"))
+		UE_LOG(LogTemp, Verbose, TEXT("Player Lost"))
 		bCanSeeActor = false;
 	}
 }
 
-void AEnemyCharacter::MoveAlongPath()
+void AEnemyCharacter::UsePerceptionFromManager()
 {
-	if ((GetActorLocation() - CurrentNode->GetActorLocation()).IsNearlyZero(PathfindingNodeAccuracy)
-		&& Path.Num() > 0)
+	bPerceptionFromManager = true;
+	// Unregistering removes the agent from the perception system so it no longer runs its own sight checks
+	if (PerceptionComponent)
 	{
-		CurrentNode = Path.Pop();
+		PerceptionComponent->OnTargetPerceptionUpdated.RemoveDynamic(this, &AEnemyCharacter::SensePlayer);
+		PerceptionComponent->UnregisterComponent();
 	}
-	else if (!(GetActorLocation() - CurrentNode->GetActorLocation()).IsNearlyZero(PathfindingNodeAccuracy))
+}
+
+bool AEnemyCharacter::HasClearShot() const
+{
+	// Perception can lag behind the target moving behind a hill, so check the terrain before firing into it
+	return !Manager || Manager->HasLineOfSight(GetPawnViewLocation(), DetectedActor->GetActorLocation());
+}
+
+void AEnemyCharacter::FollowIntegrationField(bool bTowardsTarget)
+{
+	// Take one step at a time, choosing the next node once the agent reaches the current one
+	if (DetectedActor && (Path.Num() == 0 || bRepathRequested))
 	{
-		AddMovementInput(CurrentNode->GetActorLocation() - GetActorLocation());
+		Path.Reset();
+		int32 NextNode = Manager->GetIntegrationFieldStep(DetectedActor, CurrentNode, bTowardsTarget);
+		if (NextNode != INDEX_NONE)
+		{
+			Path.Add(NextNode);
+		}
+		bRepathRequested = false;
 	}
 }
 
+bool AEnemyCharacter::NeedsNewPath() const
+{
+	return Manager && PathQueryHandle == INDEX_NONE && (Path.Num() == 0 || bRepathRequested);
+}
+
+void AEnemyCharacter::RequestPathTo(int32 EndNode)
+{
+	PathQueryGoal = EndNode;
+	PathQueryHandle = Manager->RequestPath(CurrentNode, EndNode, FPathQueryDelegate::CreateUObject(this, &AEnemyCharacter::OnPathGenerated));
+}
+
+void AEnemyCharacter::RequestRepath()
+{
+	// Drop any query made for the previous state, its goal is no longer relevant
+	if (Manager && PathQueryHandle != INDEX_NONE)
+	{
+		Manager->CancelPathQuery(PathQueryHandle);
+	}
+	PathQueryHandle = INDEX_NONE;
+	PatrolWaypoints.Empty();
+	bRepathRequested = true;
+}
+
+void AEnemyCharacter::OnPatrolRouteGenerated(const TArray<int32>& Route, bool bIsFullPath)
+{
+	// Without a route through the hierarchy the manager searched the whole way, so the nodes are walked directly
+	// instead of asking for a one node leg to each of them
+	if (bIsFullPath)
+	{
+		PatrolWaypoints.Empty();
+		OnPathGenerated(Route);
+		return;
+	}
+
+	PathQueryHandle = INDEX_NONE;
+	PatrolWaypoints = Route;
+	bRepathRequested = false;
+}
+
+void AEnemyCharacter::OnPathSegmentGenerated(const TArray<int32>& NewPath)
+{
+	// A leg that cannot be walked means the rest of the route is no good either, so a new patrol is planned
+	if (NewPath.Num() == 0)
+	{
+		PatrolWaypoints.Empty();
+	}
+	OnPathGenerated(NewPath);
+}
+
+void AEnemyCharacter::OnPathGenerated(const TArray<int32>& NewPath)
+{
+	PathQueryHandle = INDEX_NONE;
+
+	// The agent keeps walking while the query waits, so the path may now start next to a node it has already left.
+	// Walking straight to that node could cross an edge the slope test removed, so ask again from where the agent is.
+	if (NewPath.Num() > 0 && NewPath.Last() != CurrentNode && !Manager->AreNodesAdjacent(CurrentNode, NewPath.Last()))
+	{
+		RequestPathTo(PathQueryGoal);
+		return;
+	}
+
+	Path = NewPath;
+	bRepathRequested = false;
+}
@@ -30,10 +30,21 @@ protected:
 
 public:	
 
-	TArray <class ANavigationNode* > Path;
-	ANavigationNode* CurrentNode;
+	// Navigation graph indices of the nodes still to visit, the next node is at the end of the array.
+	TArray<int32> Path;
+	int32 CurrentNode;
 	class AAIManager* Manager;
 
+	// Remaining waypoints of a hierarchical patrol route, in the same format as Path. Path only holds the current leg.
+	TArray<int32> PatrolWaypoints;
+
+	// Handle of the path query waiting on the AI manager, or INDEX_NONE. The agent keeps following Path until it completes.
+	int32 PathQueryHandle;
+	// The node the pending path query is trying to reach.
+	int32 PathQueryGoal;
+	// Set when the state changes so the current path is replaced even though it has not been finished.
+	bool bRepathRequested;
+
 	UPROPERTY(EditAnywhere, meta=(UIMin="10.0", UIMax="1000.0", ClampMin="10.0", ClampMax="1000.0"))
 	float PathfindingNodeAccuracy;
 
@@ -43,12 +54,34 @@ public:
 	AgentState CurrentAgentState;
 
 	class UAIPerceptionComponent* PerceptionComponent;
+	// A UPROPERTY so the pointer is cleared when the actor is destroyed, such as a player pawn replaced on respawn.
+	UPROPERTY()
 	AActor* DetectedActor;
 	bool bCanSeeActor;
+	// Set when the AI manager works out what the agent can see, the perception component is switched off.
+	bool bPerceptionFromManager;
 
-	// Called every frame
+	// Called every frame. Agents created by an AI manager do not tick, the manager updates them all in one batch.
 	virtual void Tick(float DeltaTime) override;
 
+	/**
+	Works out the state an agent moves to this frame. Only uses its arguments so it can run on any thread.
+	@param State - The state the agent is in.
+	@param bCanSee - Whether the agent can see an actor.
+	@param HealthFraction - The agent's health remaining from 0 to 1.
+	@return The state for the agent to be in after this frame.
+	*/
+	static AgentState GetNextState(AgentState State, bool bCanSee, float HealthFraction);
+	/**
+	Runs one frame of the agent's behaviour from values already worked out for it, so only the parts that need
+	the actor are done per agent.
+	@param NextState - The state to move to after this frame's behaviour, from GetNextState.
+	@param bAtCurrentNode - Whether the agent has reached its current node.
+	@param MoveInput - The direction to the current node, used when it has not been reached.
+	*/
+	void UpdateAgent(AgentState NextState, bool bAtCurrentNode, const FVector& MoveInput);
+	float GetHealthFraction() const;
+
 	// Called to bind functionality to input
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 
@@ -58,12 +91,22 @@ public:
 
 	UFUNCTION()
 	void SensePlayer(AActor* ActorSensed, FAIStimulus Stimulus);
+	// Stops the perception component sensing for this agent so the AI manager can set DetectedActor and bCanSeeActor.
+	void UsePerceptionFromManager();
 
 	UFUNCTION(BlueprintImplementableEvent)
 	void Fire(FVector FireDirection);
 
 private:
 
-	void MoveAlongPath();
+	// Whether the terrain is clear between the agent's eyes and the detected actor.
+	bool HasClearShot() const;
+	void FollowIntegrationField(bool bTowardsTarget);
+	bool NeedsNewPath() const;
+	void RequestPathTo(int32 EndNode);
+	void RequestRepath();
+	void OnPathGenerated(const TArray<int32>& NewPath);
+	void OnPatrolRouteGenerated(const TArray<int32>& Route, bool bIsFullPath);
+	void OnPathSegmentGenerated(const TArray<int32>& NewPath);
 
 };
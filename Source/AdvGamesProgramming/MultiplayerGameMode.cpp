@@ -33,9 +33,15 @@ void AMultiplayerGameMode::InitGame(const FString& MapName, const FString& Optio
 		UE_LOG(LogTemp, Warning, TEXT("Unable to spawn the APickupManager"))
 	}
 
+	// The designed terrain is kept unless the map opts into new terrain every match, either way its descriptor is replicated to the clients
+	if (ProceduralMap)
+	{
+		ProceduralMap->PrepareForMatch();
+	}
+
 	if (ProceduralMap && PickupManager)
 	{
-		PickupManager->Init(ProceduralMap->Vertices, WeaponPickupClass, WEAPON_PICKUP_SPAWN_INTERVAL);
+		PickupManager->Init(ProceduralMap, WeaponPickupClass, WEAPON_PICKUP_SPAWN_INTERVAL);
 	}
 
 }
@@ -81,9 +87,25 @@ void AMultiplayerGameMode::TriggerRespawn(AController* Controller)
 	if (Controller)
 	{
 		AActor* SpawnPoint = ChoosePlayerStart(Controller);
+		if (SpawnPoint && ProceduralMap && !ProceduralMap->HasCollisionAt(SpawnPoint->GetActorLocation()))
+		{
+			// The terrain collision at the spawn point is still being cooked so try again shortly
+			ProceduralMap->RequestCollisionAt(SpawnPoint->GetActorLocation(), RESPAWN_COLLISION_RETRY_INTERVAL * 2.0f);
+			FTimerHandle RetryTimer;
+			FTimerDelegate RetryDelegate;
+			RetryDelegate.BindUFunction(this, TEXT("TriggerRespawn"), Controller);
+			GetWorldTimerManager().SetTimer(RetryTimer, RetryDelegate, RESPAWN_COLLISION_RETRY_INTERVAL, false);
+			return;
+		}
 		if (SpawnPoint)
 		{
-			APawn* SpawnedPlayer = GetWorld()->SpawnActor<APawn>(DefaultPawnClass, SpawnPoint->GetActorLocation(), SpawnPoint->GetActorRotation());
+			// Lift the spawn above the terrain if it has been raised over the player start
+			FVector SpawnLocation = SpawnPoint->GetActorLocation();
+			if (ProceduralMap)
+			{
+				SpawnLocation.Z = FMath::Max(SpawnLocation.Z, ProceduralMap->GetHeightAt(SpawnLocation) + RESPAWN_HEIGHT_ABOVE_TERRAIN);
+			}
+			APawn* SpawnedPlayer = GetWorld()->SpawnActor<APawn>(DefaultPawnClass, SpawnLocation, SpawnPoint->GetActorRotation());
 			if (SpawnedPlayer)
 			{
 				Controller->Possess(SpawnedPlayer);
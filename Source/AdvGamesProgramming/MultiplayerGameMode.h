@@ -16,6 +16,10 @@ class ADVGAMESPROGRAMMING_API AMultiplayerGameMode : public AGameMode
 
 private:
 	const float WEAPON_PICKUP_SPAWN_INTERVAL = 10.0f;
+	// How often a respawn waiting for terrain collision checks again.
+	const float RESPAWN_COLLISION_RETRY_INTERVAL = 0.1f;
+	// The lowest a respawned pawn is placed above the terrain surface, enough to clear its capsule.
+	const float RESPAWN_HEIGHT_ABOVE_TERRAIN = 100.0f;
 
 	class AProcedurallyGeneratedMap* ProceduralMap;
 	class APickupManager* PickupManager;
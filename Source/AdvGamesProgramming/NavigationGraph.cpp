@@ -0,0 +1,357 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavigationGraph.h"
+#include "NavigationLandmarks.h"
+
+void FNavigationSearchScratch::BeginSearch(int32 NumNodes)
+{
+	if (GScore.Num() != NumNodes)
+	{
+		// The graph has changed size so the old stamps mean nothing
+		GScore.SetNumUninitialized(NumNodes);
+		CameFrom.SetNumUninitialized(NumNodes);
+		Generation.SetNumZeroed(NumNodes);
+		ClosedGeneration.SetNumZeroed(NumNodes);
+		HeapIndex.Init(INDEX_NONE, NumNodes);
+		CurrentGeneration = 0;
+	}
+
+	CurrentGeneration++;
+	NumExpanded = 0;
+	if (CurrentGeneration == 0)
+	{
+		// The counter wrapped around so clear the stamps once to avoid matching a very old search.
+		FMemory::Memzero(Generation.GetData(), Generation.Num() * sizeof(uint32));
+		FMemory::Memzero(ClosedGeneration.GetData(), ClosedGeneration.Num() * sizeof(uint32));
+		CurrentGeneration = 1;
+	}
+
+	OpenSet.Reset();
+}
+
+void FNavigationSearchScratch::OpenSetPush(int32 Node, float FScore)
+{
+	int32 Index = OpenSet.Add({ FScore, Node });
+	HeapIndex[Node] = Index;
+	OpenSetSiftUp(Index);
+}
+
+int32 FNavigationSearchScratch::OpenSetPop()
+{
+	int32 TopNode = OpenSet[0].Node;
+	FOpenSetEntry LastEntry = OpenSet.Pop(false);
+	if (OpenSet.Num() > 0)
+	{
+		OpenSet[0] = LastEntry;
+		HeapIndex[LastEntry.Node] = 0;
+		OpenSetSiftDown(0);
+	}
+	HeapIndex[TopNode] = INDEX_NONE;
+	return TopNode;
+}
+
+void FNavigationSearchScratch::OpenSetDecreaseKey(int32 Node, float FScore)
+{
+	int32 Index = HeapIndex[Node];
+	OpenSet[Index].FScore = FScore;
+	OpenSetSiftUp(Index);
+}
+
+void FNavigationSearchScratch::OpenSetSiftUp(int32 Index)
+{
+	FOpenSetEntry Entry = OpenSet[Index];
+	while (Index > 0)
+	{
+		int32 ParentIndex = (Index - 1) / 2;
+		if (OpenSet[ParentIndex].FScore <= Entry.FScore) break;
+		OpenSet[Index] = OpenSet[ParentIndex];
+		HeapIndex[OpenSet[Index].Node] = Index;
+		Index = ParentIndex;
+	}
+	OpenSet[Index] = Entry;
+	HeapIndex[Entry.Node] = Index;
+}
+
+void FNavigationSearchScratch::OpenSetSiftDown(int32 Index)
+{
+	FOpenSetEntry Entry = OpenSet[Index];
+	const int32 Count = OpenSet.Num();
+	while (true)
+	{
+		int32 ChildIndex = Index * 2 + 1;
+		if (ChildIndex >= Count) break;
+		// Pick the smaller of the two children
+		if (ChildIndex + 1 < Count && OpenSet[ChildIndex + 1].FScore < OpenSet[ChildIndex].FScore)
+		{
+			ChildIndex++;
+		}
+		if (Entry.FScore <= OpenSet[ChildIndex].FScore) break;
+		OpenSet[Index] = OpenSet[ChildIndex];
+		HeapIndex[OpenSet[Index].Node] = Index;
+		Index = ChildIndex;
+	}
+	OpenSet[Index] = Entry;
+	HeapIndex[Entry.Node] = Index;
+}
+
+void FNavigationGraph::Empty()
+{
+	Positions.Empty();
+	EdgeOffsets.Empty();
+	EdgeTargets.Empty();
+	EdgeCosts.Empty();
+}
+
+int32 FNavigationGraph::LabelComponents(TArray<int32>& OutLabels) const
+{
+	// Union-find over the edges, every node starts as the root of its own set
+	TArray<int32> Parents;
+	Parents.SetNumUninitialized(Num());
+	for (int32 Node = 0; Node < Num(); Node++)
+	{
+		Parents[Node] = Node;
+	}
+	auto FindRoot = [&Parents](int32 Node)
+	{
+		while (Parents[Node] != Node)
+		{
+			// Path halving keeps the trees shallow without recursion
+			Parents[Node] = Parents[Parents[Node]];
+			Node = Parents[Node];
+		}
+		return Node;
+	};
+
+	for (int32 Node = 0; Node < Num(); Node++)
+	{
+		for (int32 Edge = EdgeOffsets[Node]; Edge < EdgeOffsets[Node + 1]; Edge++)
+		{
+			const int32 RootA = FindRoot(Node);
+			const int32 RootB = FindRoot(EdgeTargets[Edge]);
+			if (RootA != RootB)
+			{
+				// Joining onto the smaller index keeps every root the first node of its component
+				Parents[FMath::Max(RootA, RootB)] = FMath::Min(RootA, RootB);
+			}
+		}
+	}
+
+	// Roots are visited before the rest of their component so labels are handed out in order of first node
+	int32 NumComponents = 0;
+	OutLabels.SetNumUninitialized(Num());
+	for (int32 Node = 0; Node < Num(); Node++)
+	{
+		const int32 Root = FindRoot(Node);
+		OutLabels[Node] = Root == Node ? NumComponents++ : OutLabels[Root];
+	}
+	return NumComponents;
+}
+
+void FNavigationGraph::Build(const TArray<FVector>& NodePositions, const TArray<TArray<int32>>& Adjacency)
+{
+	check(NodePositions.Num() == Adjacency.Num());
+
+	Positions = NodePositions;
+
+	int32 NumEdges = 0;
+	for (const TArray<int32>& Neighbours : Adjacency)
+	{
+		NumEdges += Neighbours.Num();
+	}
+
+	EdgeOffsets.Reset(Positions.Num() + 1);
+	EdgeTargets.Reset(NumEdges);
+	EdgeCosts.Reset(NumEdges);
+
+	for (int32 Node = 0; Node < Adjacency.Num(); Node++)
+	{
+		EdgeOffsets.Add(EdgeTargets.Num());
+		for (int32 Neighbour : Adjacency[Node])
+		{
+			EdgeTargets.Add(Neighbour);
+			EdgeCosts.Add(FVector::Dist(Positions[Node], Positions[Neighbour]));
+		}
+	}
+	EdgeOffsets.Add(EdgeTargets.Num());
+}
+
+void FNavigationGraph::UpdateNodes(const TArray<int32>& Nodes, const TArray<TArray<int32>>& Adjacency)
+{
+	check(Nodes.Num() == Adjacency.Num());
+
+	// When every node keeps the same number of edges they can be overwritten where they are
+	bool bSameEdgeCounts = true;
+	for (int32 i = 0; i < Nodes.Num() && bSameEdgeCounts; i++)
+	{
+		bSameEdgeCounts = EdgeOffsets[Nodes[i] + 1] - EdgeOffsets[Nodes[i]] == Adjacency[i].Num();
+	}
+
+	if (bSameEdgeCounts)
+	{
+		for (int32 i = 0; i < Nodes.Num(); i++)
+		{
+			const int32 Node = Nodes[i];
+			for (int32 j = 0; j < Adjacency[i].Num(); j++)
+			{
+				const int32 Neighbour = Adjacency[i][j];
+				EdgeTargets[EdgeOffsets[Node] + j] = Neighbour;
+				EdgeCosts[EdgeOffsets[Node] + j] = FVector::Dist(Positions[Node], Positions[Neighbour]);
+			}
+		}
+		return;
+	}
+
+	// Otherwise the edge arrays are laid out again, the edges of the other nodes are copied across unchanged
+	TArray<int32> ChangedIndex;
+	ChangedIndex.Init(INDEX_NONE, Num());
+	for (int32 i = 0; i < Nodes.Num(); i++)
+	{
+		ChangedIndex[Nodes[i]] = i;
+	}
+
+	TArray<int32> NewEdgeOffsets;
+	TArray<int32> NewEdgeTargets;
+	TArray<float> NewEdgeCosts;
+	NewEdgeOffsets.Reserve(Num() + 1);
+	NewEdgeTargets.Reserve(EdgeTargets.Num());
+	NewEdgeCosts.Reserve(EdgeCosts.Num());
+	for (int32 Node = 0; Node < Num(); Node++)
+	{
+		NewEdgeOffsets.Add(NewEdgeTargets.Num());
+		if (ChangedIndex[Node] == INDEX_NONE)
+		{
+			const int32 NumEdges = EdgeOffsets[Node + 1] - EdgeOffsets[Node];
+			NewEdgeTargets.Append(&EdgeTargets[EdgeOffsets[Node]], NumEdges);
+			NewEdgeCosts.Append(&EdgeCosts[EdgeOffsets[Node]], NumEdges);
+		}
+		else
+		{
+			for (int32 Neighbour : Adjacency[ChangedIndex[Node]])
+			{
+				NewEdgeTargets.Add(Neighbour);
+				NewEdgeCosts.Add(FVector::Dist(Positions[Node], Positions[Neighbour]));
+			}
+		}
+	}
+	NewEdgeOffsets.Add(NewEdgeTargets.Num());
+
+	EdgeOffsets = MoveTemp(NewEdgeOffsets);
+	EdgeTargets = MoveTemp(NewEdgeTargets);
+	EdgeCosts = MoveTemp(NewEdgeCosts);
+}
+
+bool FNavigationGraph::FindPath(int32 StartNode, int32 EndNode, FNavigationSearchScratch& Scratch, TArray<int32>& OutPath, const FNavigationLandmarks* Landmarks) const
+{
+	OutPath.Reset();
+	if (!IsValidNode(StartNode) || !IsValidNode(EndNode))
+	{
+		return false;
+	}
+
+	Scratch.BeginSearch(Num());
+
+	const FVector EndPosition = Positions[EndNode];
+	auto GetHScore = [&](int32 Node)
+	{
+		const float Distance = FVector::Dist(Positions[Node], EndPosition);
+		return Landmarks ? FMath::Max(Distance, Landmarks->GetLowerBound(Node, EndNode)) : Distance;
+	};
+
+	// Set start node GScore to zero and add it to the open set
+	Scratch.Generation[StartNode] = Scratch.CurrentGeneration;
+	Scratch.GScore[StartNode] = 0.0f;
+	Scratch.CameFrom[StartNode] = INDEX_NONE;
+	Scratch.OpenSetPush(StartNode, GetHScore(StartNode));
+
+	// Loop through the open set until it is empty
+	while (Scratch.OpenSet.Num() > 0)
+	{
+		// The top of the heap is the node with the lowest FScore
+		int32 CurrentNode = Scratch.OpenSetPop();
+		Scratch.ClosedGeneration[CurrentNode] = Scratch.CurrentGeneration;
+		Scratch.NumExpanded++;
+
+		// If the current node is the end node then walk back through CameFrom to build the path
+		if (CurrentNode == EndNode)
+		{
+			while (CurrentNode != StartNode)
+			{
+				OutPath.Add(CurrentNode);
+				CurrentNode = Scratch.CameFrom[CurrentNode];
+			}
+			return true;
+		}
+
+		const float CurrentGScore = Scratch.GScore[CurrentNode];
+		for (int32 Edge = EdgeOffsets[CurrentNode]; Edge < EdgeOffsets[CurrentNode + 1]; Edge++)
+		{
+			const int32 Neighbour = EdgeTargets[Edge];
+
+			// Nodes in the closed set already have their best score as the heuristic is consistent. The rounding of
+			// the landmark bound can break this by less than one quantisation step, which a path can only be longer by.
+			if (Scratch.IsClosed(Neighbour)) continue;
+
+			const float TentativeGScore = CurrentGScore + EdgeCosts[Edge];
+			if (!Scratch.IsVisited(Neighbour))
+			{
+				Scratch.Generation[Neighbour] = Scratch.CurrentGeneration;
+				Scratch.GScore[Neighbour] = TentativeGScore;
+				Scratch.CameFrom[Neighbour] = CurrentNode;
+				Scratch.OpenSetPush(Neighbour, TentativeGScore + GetHScore(Neighbour));
+			}
+			else if (TentativeGScore < Scratch.GScore[Neighbour])
+			{
+				// Decrease key, the heuristic part of the FScore does not change
+				const float HScore = Scratch.OpenSet[Scratch.HeapIndex[Neighbour]].FScore - Scratch.GScore[Neighbour];
+				Scratch.GScore[Neighbour] = TentativeGScore;
+				Scratch.CameFrom[Neighbour] = CurrentNode;
+				Scratch.OpenSetDecreaseKey(Neighbour, TentativeGScore + HScore);
+			}
+		}
+	}
+
+	// If it exits this loop then no valid path has been found so return an empty path.
+	return false;
+}
+
+void FNavigationGraph::BuildCostField(int32 SourceNode, FNavigationSearchScratch& Scratch, TArray<float>& OutCosts) const
+{
+	OutCosts.Init(TNumericLimits<float>::Max(), Num());
+	if (!IsValidNode(SourceNode))
+	{
+		return;
+	}
+
+	Scratch.BeginSearch(Num());
+	Scratch.Generation[SourceNode] = Scratch.CurrentGeneration;
+	Scratch.GScore[SourceNode] = 0.0f;
+	Scratch.OpenSetPush(SourceNode, 0.0f);
+
+	while (Scratch.OpenSet.Num() > 0)
+	{
+		const int32 CurrentNode = Scratch.OpenSetPop();
+		Scratch.ClosedGeneration[CurrentNode] = Scratch.CurrentGeneration;
+		const float CurrentCost = Scratch.GScore[CurrentNode];
+		OutCosts[CurrentNode] = CurrentCost;
+
+		for (int32 Edge = EdgeOffsets[CurrentNode]; Edge < EdgeOffsets[CurrentNode + 1]; Edge++)
+		{
+			const int32 Neighbour = EdgeTargets[Edge];
+			if (Scratch.IsClosed(Neighbour)) continue;
+
+			const float TentativeCost = CurrentCost + EdgeCosts[Edge];
+			if (!Scratch.IsVisited(Neighbour))
+			{
+				Scratch.Generation[Neighbour] = Scratch.CurrentGeneration;
+				Scratch.GScore[Neighbour] = TentativeCost;
+				Scratch.OpenSetPush(Neighbour, TentativeCost);
+			}
+			else if (TentativeCost < Scratch.GScore[Neighbour])
+			{
+				Scratch.GScore[Neighbour] = TentativeCost;
+				Scratch.OpenSetDecreaseKey(Neighbour, TentativeCost);
+			}
+		}
+	}
+}
@@ -0,0 +1,107 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+Per-query working memory for a search over an FNavigationGraph.
+Scores are stamped with a generation so nothing has to be reset between searches. Each thread
+that runs searches must own its own scratch.
+*/
+struct ADVGAMESPROGRAMMING_API FNavigationSearchScratch
+{
+	struct FOpenSetEntry
+	{
+		float FScore;
+		int32 Node;
+	};
+
+	TArray<float> GScore;
+	TArray<int32> CameFrom;
+	// The search generation that GScore and CameFrom were last written in.
+	TArray<uint32> Generation;
+	// The search generation in which the node was added to the closed set.
+	TArray<uint32> ClosedGeneration;
+	// Position of the node in OpenSet, or INDEX_NONE when it is not in the heap.
+	TArray<int32> HeapIndex;
+	// Binary min-heap ordered by FScore.
+	TArray<FOpenSetEntry> OpenSet;
+
+	uint32 CurrentGeneration = 0;
+	// The number of nodes the last search took off the open set.
+	int32 NumExpanded = 0;
+
+	// Starts a new search over a graph with the given number of nodes.
+	void BeginSearch(int32 NumNodes);
+
+	bool IsVisited(int32 Node) const { return Generation[Node] == CurrentGeneration; }
+	bool IsClosed(int32 Node) const { return ClosedGeneration[Node] == CurrentGeneration; }
+
+	void OpenSetPush(int32 Node, float FScore);
+	int32 OpenSetPop();
+	void OpenSetDecreaseKey(int32 Node, float FScore);
+
+private:
+	void OpenSetSiftUp(int32 Index);
+	void OpenSetSiftDown(int32 Index);
+};
+
+/**
+Compact struct-of-arrays navigation graph. Node positions are stored contiguously and the adjacency
+is stored in compressed sparse row form: the neighbours of node N are EdgeTargets[EdgeOffsets[N]] up to
+EdgeTargets[EdgeOffsets[N + 1] - 1], with the matching travel cost in EdgeCosts.
+*/
+struct ADVGAMESPROGRAMMING_API FNavigationGraph
+{
+	TArray<FVector> Positions;
+	TArray<int32> EdgeOffsets;
+	TArray<int32> EdgeTargets;
+	TArray<float> EdgeCosts;
+
+	int32 Num() const { return Positions.Num(); }
+	bool IsValidNode(int32 Node) const { return Node >= 0 && Node < Positions.Num(); }
+
+	void Empty();
+
+	/**
+	Builds the graph from node positions and per node neighbour lists.
+	@param NodePositions - The location of every node.
+	@param Adjacency - The indices of the nodes connected to each node.
+	*/
+	void Build(const TArray<FVector>& NodePositions, const TArray<TArray<int32>>& Adjacency);
+
+	/**
+	Replaces the edges of some of the nodes, recalculating their costs from the current positions.
+	@param Nodes - The nodes whose edges are replaced.
+	@param Adjacency - The new neighbours of each node in Nodes.
+	*/
+	void UpdateNodes(const TArray<int32>& Nodes, const TArray<TArray<int32>>& Adjacency);
+
+	/**
+	Labels the connected components of the graph. Every edge is treated as two way, so nodes with different labels
+	can never reach each other.
+	@param OutLabels - Filled with the component of every node, numbered from zero.
+	@return The number of components.
+	*/
+	int32 LabelComponents(TArray<int32>& OutLabels) const;
+
+	/**
+	Runs an A* search between two nodes.
+	@param StartNode - The index of the node the search starts from.
+	@param EndNode - The index of the node the search is trying to reach.
+	@param Scratch - The working memory used by this search.
+	@param OutPath - Filled with the path from the end node back towards the start node, excluding the start node.
+	@param Landmarks - When given, the landmark bound is used as the heuristic wherever it beats the straight line distance.
+	@return Whether a path was found.
+	*/
+	bool FindPath(int32 StartNode, int32 EndNode, FNavigationSearchScratch& Scratch, TArray<int32>& OutPath, const class FNavigationLandmarks* Landmarks = nullptr) const;
+
+	/**
+	Runs a Dijkstra search from one node over the whole graph.
+	@param SourceNode - The index of the node the costs are measured from.
+	@param Scratch - The working memory used by this search.
+	@param OutCosts - Filled with the travel cost from the source to every node, TNumericLimits<float>::Max() if unreachable.
+	*/
+	void BuildCostField(int32 SourceNode, FNavigationSearchScratch& Scratch, TArray<float>& OutCosts) const;
+};
@@ -0,0 +1,532 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavigationHierarchy.h"
+#include "Misc/Crc.h"
+
+namespace
+{
+	bool HasEdge(const FNavigationGraph& Graph, int32 FromNode, int32 ToNode)
+	{
+		for (int32 Edge = Graph.EdgeOffsets[FromNode]; Edge < Graph.EdgeOffsets[FromNode + 1]; Edge++)
+		{
+			if (Graph.EdgeTargets[Edge] == ToNode) return true;
+		}
+		return false;
+	}
+}
+
+void FNavigationHierarchy::Empty()
+{
+	Width = 0;
+	Height = 0;
+	ClusterSize = 0;
+	NumClustersX = 0;
+	NumClustersY = 0;
+	Clusters.Empty();
+	VerticalBorders.Empty();
+	HorizontalBorders.Empty();
+	AbstractNodes.Empty();
+	BaseToAbstract.Empty();
+	AbstractEdgeOffsets.Empty();
+	AbstractEdgeTargets.Empty();
+	AbstractEdgeCosts.Empty();
+}
+
+int32 FNavigationHierarchy::GetCluster(int32 Node) const
+{
+	return (Node / Width / ClusterSize) * NumClustersX + (Node % Width) / ClusterSize;
+}
+
+int32 FNavigationHierarchy::Build(const FNavigationGraph& Graph, int32 InWidth, int32 InHeight, int32 InClusterSize)
+{
+	if (Graph.Num() == 0 || Graph.Num() != InWidth * InHeight || InClusterSize < 2)
+	{
+		Empty();
+		return 0;
+	}
+
+	// A different layout means nothing from the previous build can be kept
+	const bool bFullRebuild = !IsBuilt() || Width != InWidth || Height != InHeight || ClusterSize != InClusterSize;
+	if (bFullRebuild)
+	{
+		Empty();
+		Width = InWidth;
+		Height = InHeight;
+		ClusterSize = InClusterSize;
+		NumClustersX = FMath::DivideAndRoundUp(Width, ClusterSize);
+		NumClustersY = FMath::DivideAndRoundUp(Height, ClusterSize);
+		Clusters.SetNum(NumClustersX * NumClustersY);
+		VerticalBorders.SetNum((NumClustersX - 1) * NumClustersY);
+		HorizontalBorders.SetNum(NumClustersX * (NumClustersY - 1));
+	}
+
+	// Find the clusters whose content changed
+	TArray<bool> ClusterChanged;
+	ClusterChanged.Init(bFullRebuild, Clusters.Num());
+	for (int32 Cluster = 0; Cluster < Clusters.Num(); Cluster++)
+	{
+		const uint32 Hash = HashCluster(Graph, Cluster);
+		if (Hash != Clusters[Cluster].Hash)
+		{
+			ClusterChanged[Cluster] = true;
+			Clusters[Cluster].Hash = Hash;
+		}
+	}
+
+	return RebuildClusters(Graph, ClusterChanged);
+}
+
+int32 FNavigationHierarchy::UpdateRegion(const FNavigationGraph& Graph, int32 MinX, int32 MinY, int32 MaxX, int32 MaxY)
+{
+	if (!IsBuilt() || Graph.Num() != Width * Height)
+	{
+		return 0;
+	}
+
+	// Only the clusters overlapping the region can have changed, so only those are hashed again
+	TArray<bool> ClusterChanged;
+	ClusterChanged.Init(false, Clusters.Num());
+	const int32 MinClusterX = FMath::Clamp(MinX, 0, Width - 1) / ClusterSize;
+	const int32 MinClusterY = FMath::Clamp(MinY, 0, Height - 1) / ClusterSize;
+	const int32 MaxClusterX = FMath::Clamp(MaxX, 0, Width - 1) / ClusterSize;
+	const int32 MaxClusterY = FMath::Clamp(MaxY, 0, Height - 1) / ClusterSize;
+	bool bAnyChanged = false;
+	for (int32 ClusterY = MinClusterY; ClusterY <= MaxClusterY; ClusterY++)
+	{
+		for (int32 ClusterX = MinClusterX; ClusterX <= MaxClusterX; ClusterX++)
+		{
+			const int32 Cluster = ClusterY * NumClustersX + ClusterX;
+			const uint32 Hash = HashCluster(Graph, Cluster);
+			if (Hash != Clusters[Cluster].Hash)
+			{
+				ClusterChanged[Cluster] = true;
+				Clusters[Cluster].Hash = Hash;
+				bAnyChanged = true;
+			}
+		}
+	}
+
+	return bAnyChanged ? RebuildClusters(Graph, ClusterChanged) : 0;
+}
+
+int32 FNavigationHierarchy::RebuildClusters(const FNavigationGraph& Graph, const TArray<bool>& ClusterChanged)
+{
+	// Rebuild the borders around changed clusters. A neighbour only needs new costs if its entrances moved.
+	TArray<bool> ClusterNeedsCosts = ClusterChanged;
+	for (int32 ClusterY = 0; ClusterY < NumClustersY; ClusterY++)
+	{
+		for (int32 ClusterX = 0; ClusterX < NumClustersX; ClusterX++)
+		{
+			const int32 Cluster = ClusterY * NumClustersX + ClusterX;
+			if (ClusterX < NumClustersX - 1 && (ClusterChanged[Cluster] || ClusterChanged[Cluster + 1]))
+			{
+				TArray<FTransition>& Border = VerticalBorders[ClusterY * (NumClustersX - 1) + ClusterX];
+				TArray<FTransition> NewBorder;
+				BuildBorder(Graph, ClusterX, ClusterY, true, NewBorder);
+				if (NewBorder != Border)
+				{
+					Border = MoveTemp(NewBorder);
+					ClusterNeedsCosts[Cluster] = true;
+					ClusterNeedsCosts[Cluster + 1] = true;
+				}
+			}
+			if (ClusterY < NumClustersY - 1 && (ClusterChanged[Cluster] || ClusterChanged[Cluster + NumClustersX]))
+			{
+				TArray<FTransition>& Border = HorizontalBorders[ClusterY * NumClustersX + ClusterX];
+				TArray<FTransition> NewBorder;
+				BuildBorder(Graph, ClusterX, ClusterY, false, NewBorder);
+				if (NewBorder != Border)
+				{
+					Border = MoveTemp(NewBorder);
+					ClusterNeedsCosts[Cluster] = true;
+					ClusterNeedsCosts[Cluster + NumClustersX] = true;
+				}
+			}
+		}
+	}
+
+	int32 NumRebuilt = 0;
+	for (int32 Cluster = 0; Cluster < Clusters.Num(); Cluster++)
+	{
+		if (ClusterNeedsCosts[Cluster])
+		{
+			BuildClusterCosts(Graph, Cluster, BuildScratch);
+			NumRebuilt++;
+		}
+	}
+
+	BuildAbstractGraph();
+	return NumRebuilt;
+}
+
+uint32 FNavigationHierarchy::HashCluster(const FNavigationGraph& Graph, int32 Cluster) const
+{
+	const int32 MinX = (Cluster % NumClustersX) * ClusterSize;
+	const int32 MinY = (Cluster / NumClustersX) * ClusterSize;
+	const int32 MaxX = FMath::Min(MinX + ClusterSize, Width);
+	const int32 MaxY = FMath::Min(MinY + ClusterSize, Height);
+
+	// Hash every row of positions and the edges leaving its nodes
+	uint32 Hash = 0;
+	for (int32 Y = MinY; Y < MaxY; Y++)
+	{
+		const int32 RowStart = Y * Width + MinX;
+		const int32 RowEnd = Y * Width + MaxX;
+		Hash = FCrc::MemCrc32(&Graph.Positions[RowStart], (RowEnd - RowStart) * sizeof(FVector), Hash);
+		const int32 FirstEdge = Graph.EdgeOffsets[RowStart];
+		const int32 LastEdge = Graph.EdgeOffsets[RowEnd];
+		if (LastEdge > FirstEdge)
+		{
+			Hash = FCrc::MemCrc32(&Graph.EdgeTargets[FirstEdge], (LastEdge - FirstEdge) * sizeof(int32), Hash);
+		}
+	}
+	return Hash;
+}
+
+void FNavigationHierarchy::BuildBorder(const FNavigationGraph& Graph, int32 ClusterX, int32 ClusterY, bool bVertical, TArray<FTransition>& OutTransitions) const
+{
+	OutTransitions.Reset();
+
+	// Walk along the border. For a vertical border the A side is the last column of the left cluster.
+	const int32 Start = bVertical ? ClusterY * ClusterSize : ClusterX * ClusterSize;
+	const int32 End = bVertical ? FMath::Min(Start + ClusterSize, Height) : FMath::Min(Start + ClusterSize, Width);
+	const int32 Line = bVertical ? (ClusterX + 1) * ClusterSize - 1 : (ClusterY + 1) * ClusterSize - 1;
+
+	auto GetNodeA = [&](int32 i) { return bVertical ? i * Width + Line : Line * Width + i; };
+	auto GetNodeB = [&](int32 i) { return bVertical ? i * Width + Line + 1 : (Line + 1) * Width + i; };
+
+	// A border position can be crossed straight over or diagonally to either neighbour along the border, otherwise
+	// clusters only joined by diagonal edges would have no entrance between them
+	auto FindCrossing = [&](int32 i, int32& OutNodeB)
+	{
+		const int32 NodeA = GetNodeA(i);
+		const int32 Candidates[3] = { i, i + 1, i - 1 };
+		for (int32 Candidate : Candidates)
+		{
+			if (Candidate >= Start && Candidate < End && HasEdge(Graph, NodeA, GetNodeB(Candidate)))
+			{
+				OutNodeB = GetNodeB(Candidate);
+				return true;
+			}
+		}
+		return false;
+	};
+
+	// Each run of crossable border positions gets one entrance in its middle
+	int32 RunStart = INDEX_NONE;
+	int32 NodeB = INDEX_NONE;
+	for (int32 i = Start; i <= End; i++)
+	{
+		const bool bCrossable = i < End && FindCrossing(i, NodeB);
+		if (bCrossable && RunStart == INDEX_NONE)
+		{
+			RunStart = i;
+		}
+		else if (!bCrossable && RunStart != INDEX_NONE)
+		{
+			const int32 Middle = (RunStart + i - 1) / 2;
+			const int32 NodeA = GetNodeA(Middle);
+			FindCrossing(Middle, NodeB);
+			OutTransitions.Add({ NodeA, NodeB, FVector::Dist(Graph.Positions[NodeA], Graph.Positions[NodeB]) });
+			RunStart = INDEX_NONE;
+		}
+	}
+}
+
+void FNavigationHierarchy::BuildClusterCosts(const FNavigationGraph& Graph, int32 Cluster, FNavigationSearchScratch& Scratch)
+{
+	const int32 ClusterX = Cluster % NumClustersX;
+	const int32 ClusterY = Cluster / NumClustersX;
+	FCluster& ClusterData = Clusters[Cluster];
+
+	// Gather the entrances from the borders on all four sides
+	ClusterData.Entrances.Reset();
+	if (ClusterX > 0)
+	{
+		for (const FTransition& Transition : VerticalBorders[ClusterY * (NumClustersX - 1) + ClusterX - 1]) ClusterData.Entrances.AddUnique(Transition.NodeB);
+	}
+	if (ClusterX < NumClustersX - 1)
+	{
+		for (const FTransition& Transition : VerticalBorders[ClusterY * (NumClustersX - 1) + ClusterX]) ClusterData.Entrances.AddUnique(Transition.NodeA);
+	}
+	if (ClusterY > 0)
+	{
+		for (const FTransition& Transition : HorizontalBorders[(ClusterY - 1) * NumClustersX + ClusterX]) ClusterData.Entrances.AddUnique(Transition.NodeB);
+	}
+	if (ClusterY < NumClustersY - 1)
+	{
+		for (const FTransition& Transition : HorizontalBorders[ClusterY * NumClustersX + ClusterX]) ClusterData.Entrances.AddUnique(Transition.NodeA);
+	}
+
+	// One Dijkstra search per entrance gives the costs to all the others
+	const int32 NumEntrances = ClusterData.Entrances.Num();
+	ClusterData.IntraCosts.Init(TNumericLimits<float>::Max(), NumEntrances * NumEntrances);
+	for (int32 From = 0; From < NumEntrances; From++)
+	{
+		SearchCluster(Graph, ClusterData.Entrances[From], INDEX_NONE, Cluster, Scratch);
+		for (int32 To = 0; To < NumEntrances; To++)
+		{
+			const int32 ToNode = ClusterData.Entrances[To];
+			if (Scratch.IsClosed(ToNode))
+			{
+				ClusterData.IntraCosts[From * NumEntrances + To] = Scratch.GScore[ToNode];
+			}
+		}
+	}
+}
+
+void FNavigationHierarchy::BuildAbstractGraph()
+{
+	AbstractNodes.Reset();
+	BaseToAbstract.Reset();
+	for (const FCluster& Cluster : Clusters)
+	{
+		for (int32 Entrance : Cluster.Entrances)
+		{
+			BaseToAbstract.Add(Entrance, AbstractNodes.Add(Entrance));
+		}
+	}
+
+	TArray<TArray<TPair<int32, float>>> Adjacency;
+	Adjacency.SetNum(AbstractNodes.Num());
+
+	// Edges inside each cluster
+	for (const FCluster& Cluster : Clusters)
+	{
+		const int32 NumEntrances = Cluster.Entrances.Num();
+		for (int32 From = 0; From < NumEntrances; From++)
+		{
+			for (int32 To = 0; To < NumEntrances; To++)
+			{
+				const float Cost = Cluster.IntraCosts[From * NumEntrances + To];
+				if (From != To && Cost < TNumericLimits<float>::Max())
+				{
+					Adjacency[BaseToAbstract[Cluster.Entrances[From]]].Add(TPair<int32, float>(BaseToAbstract[Cluster.Entrances[To]], Cost));
+				}
+			}
+		}
+	}
+
+	// Edges across the cluster borders
+	auto AddTransitions = [&](const TArray<TArray<FTransition>>& Borders)
+	{
+		for (const TArray<FTransition>& Border : Borders)
+		{
+			for (const FTransition& Transition : Border)
+			{
+				const int32 A = BaseToAbstract[Transition.NodeA];
+				const int32 B = BaseToAbstract[Transition.NodeB];
+				Adjacency[A].Add(TPair<int32, float>(B, Transition.Cost));
+				Adjacency[B].Add(TPair<int32, float>(A, Transition.Cost));
+			}
+		}
+	};
+	AddTransitions(VerticalBorders);
+	AddTransitions(HorizontalBorders);
+
+	AbstractEdgeOffsets.Reset(AbstractNodes.Num() + 1);
+	AbstractEdgeTargets.Reset();
+	AbstractEdgeCosts.Reset();
+	for (const TArray<TPair<int32, float>>& Edges : Adjacency)
+	{
+		AbstractEdgeOffsets.Add(AbstractEdgeTargets.Num());
+		for (const TPair<int32, float>& Edge : Edges)
+		{
+			AbstractEdgeTargets.Add(Edge.Key);
+			AbstractEdgeCosts.Add(Edge.Value);
+		}
+	}
+	AbstractEdgeOffsets.Add(AbstractEdgeTargets.Num());
+}
+
+void FNavigationHierarchy::SearchCluster(const FNavigationGraph& Graph, int32 SourceNode, int32 TargetNode, int32 Cluster, FNavigationSearchScratch& Scratch) const
+{
+	Scratch.BeginSearch(Graph.Num());
+
+	const bool bHasTarget = TargetNode != INDEX_NONE;
+	const FVector TargetPosition = bHasTarget ? Graph.Positions[TargetNode] : FVector::ZeroVector;
+
+	Scratch.Generation[SourceNode] = Scratch.CurrentGeneration;
+	Scratch.GScore[SourceNode] = 0.0f;
+	Scratch.CameFrom[SourceNode] = INDEX_NONE;
+	Scratch.OpenSetPush(SourceNode, bHasTarget ? FVector::Dist(Graph.Positions[SourceNode], TargetPosition) : 0.0f);
+
+	while (Scratch.OpenSet.Num() > 0)
+	{
+		const int32 CurrentNode = Scratch.OpenSetPop();
+		Scratch.ClosedGeneration[CurrentNode] = Scratch.CurrentGeneration;
+		if (CurrentNode == TargetNode) return;
+
+		const float CurrentGScore = Scratch.GScore[CurrentNode];
+		for (int32 Edge = Graph.EdgeOffsets[CurrentNode]; Edge < Graph.EdgeOffsets[CurrentNode + 1]; Edge++)
+		{
+			const int32 Neighbour = Graph.EdgeTargets[Edge];
+			if (Scratch.IsClosed(Neighbour) || GetCluster(Neighbour) != Cluster) continue;
+
+			const float TentativeGScore = CurrentGScore + Graph.EdgeCosts[Edge];
+			if (!Scratch.IsVisited(Neighbour))
+			{
+				Scratch.Generation[Neighbour] = Scratch.CurrentGeneration;
+				Scratch.GScore[Neighbour] = TentativeGScore;
+				Scratch.CameFrom[Neighbour] = CurrentNode;
+				Scratch.OpenSetPush(Neighbour, TentativeGScore + (bHasTarget ? FVector::Dist(Graph.Positions[Neighbour], TargetPosition) : 0.0f));
+			}
+			else if (TentativeGScore < Scratch.GScore[Neighbour])
+			{
+				const float HScore = Scratch.OpenSet[Scratch.HeapIndex[Neighbour]].FScore - Scratch.GScore[Neighbour];
+				Scratch.GScore[Neighbour] = TentativeGScore;
+				Scratch.CameFrom[Neighbour] = CurrentNode;
+				Scratch.OpenSetDecreaseKey(Neighbour, TentativeGScore + HScore);
+			}
+		}
+	}
+}
+
+bool FNavigationHierarchy::FindAbstractPath(const FNavigationGraph& Graph, int32 StartNode, int32 EndNode,
+	FNavigationSearchScratch& Scratch, FNavigationSearchScratch& AbstractScratch, TArray<int32>& OutWaypoints) const
+{
+	OutWaypoints.Reset();
+	if (!IsBuilt() || !Graph.IsValidNode(StartNode) || !Graph.IsValidNode(EndNode) || Graph.Num() != Width * Height)
+	{
+		return false;
+	}
+
+	const int32 StartCluster = GetCluster(StartNode);
+	const int32 EndCluster = GetCluster(EndNode);
+
+	// Connect the start node to the entrances of its cluster
+	TArray<TPair<int32, float>> StartEdges;
+	SearchCluster(Graph, StartNode, INDEX_NONE, StartCluster, Scratch);
+	for (int32 Entrance : Clusters[StartCluster].Entrances)
+	{
+		if (Scratch.IsClosed(Entrance))
+		{
+			StartEdges.Add(TPair<int32, float>(BaseToAbstract[Entrance], Scratch.GScore[Entrance]));
+		}
+	}
+
+	// Connect the entrances of the end cluster to the end node, the graph is undirected so search from the end
+	TMap<int32, float> EndEdges;
+	SearchCluster(Graph, EndNode, INDEX_NONE, EndCluster, Scratch);
+	for (int32 Entrance : Clusters[EndCluster].Entrances)
+	{
+		if (Scratch.IsClosed(Entrance))
+		{
+			EndEdges.Add(BaseToAbstract[Entrance], Scratch.GScore[Entrance]);
+		}
+	}
+	const bool bDirectRoute = StartCluster == EndCluster && Scratch.IsClosed(StartNode);
+	const float DirectCost = bDirectRoute ? Scratch.GScore[StartNode] : 0.0f;
+
+	// The start and end nodes are added to the abstract graph as two temporary nodes
+	const int32 StartId = AbstractNodes.Num();
+	const int32 EndId = StartId + 1;
+	auto GetBaseNode = [&](int32 Id) { return Id == StartId ? StartNode : (Id == EndId ? EndNode : AbstractNodes[Id]); };
+	const FVector EndPosition = Graph.Positions[EndNode];
+
+	AbstractScratch.BeginSearch(AbstractNodes.Num() + 2);
+	AbstractScratch.Generation[StartId] = AbstractScratch.CurrentGeneration;
+	AbstractScratch.GScore[StartId] = 0.0f;
+	AbstractScratch.CameFrom[StartId] = INDEX_NONE;
+	AbstractScratch.OpenSetPush(StartId, FVector::Dist(Graph.Positions[StartNode], EndPosition));
+
+	auto Relax = [&](int32 FromId, int32 ToId, float Cost)
+	{
+		if (AbstractScratch.IsClosed(ToId)) return;
+		const float TentativeGScore = AbstractScratch.GScore[FromId] + Cost;
+		if (!AbstractScratch.IsVisited(ToId))
+		{
+			AbstractScratch.Generation[ToId] = AbstractScratch.CurrentGeneration;
+			AbstractScratch.GScore[ToId] = TentativeGScore;
+			AbstractScratch.CameFrom[ToId] = FromId;
+			AbstractScratch.OpenSetPush(ToId, TentativeGScore + FVector::Dist(Graph.Positions[GetBaseNode(ToId)], EndPosition));
+		}
+		else if (TentativeGScore < AbstractScratch.GScore[ToId])
+		{
+			const float HScore = AbstractScratch.OpenSet[AbstractScratch.HeapIndex[ToId]].FScore - AbstractScratch.GScore[ToId];
+			AbstractScratch.GScore[ToId] = TentativeGScore;
+			AbstractScratch.CameFrom[ToId] = FromId;
+			AbstractScratch.OpenSetDecreaseKey(ToId, TentativeGScore + HScore);
+		}
+	};
+
+	while (AbstractScratch.OpenSet.Num() > 0)
+	{
+		int32 CurrentId = AbstractScratch.OpenSetPop();
+		AbstractScratch.ClosedGeneration[CurrentId] = AbstractScratch.CurrentGeneration;
+
+		if (CurrentId == EndId)
+		{
+			// Walk back to the start, skipping waypoints that land on the same node as the one before
+			while (CurrentId != StartId)
+			{
+				const int32 BaseNode = GetBaseNode(CurrentId);
+				if (BaseNode != StartNode && (OutWaypoints.Num() == 0 || OutWaypoints.Last() != BaseNode))
+				{
+					OutWaypoints.Add(BaseNode);
+				}
+				CurrentId = AbstractScratch.CameFrom[CurrentId];
+			}
+			return true;
+		}
+
+		if (CurrentId == StartId)
+		{
+			for (const TPair<int32, float>& Edge : StartEdges)
+			{
+				Relax(StartId, Edge.Key, Edge.Value);
+			}
+			if (bDirectRoute)
+			{
+				Relax(StartId, EndId, DirectCost);
+			}
+			continue;
+		}
+
+		for (int32 Edge = AbstractEdgeOffsets[CurrentId]; Edge < AbstractEdgeOffsets[CurrentId + 1]; Edge++)
+		{
+			Relax(CurrentId, AbstractEdgeTargets[Edge], AbstractEdgeCosts[Edge]);
+		}
+		if (const float* EndCost = EndEdges.Find(CurrentId))
+		{
+			Relax(CurrentId, EndId, *EndCost);
+		}
+	}
+
+	return false;
+}
+
+bool FNavigationHierarchy::RefineSegment(const FNavigationGraph& Graph, int32 FromNode, int32 ToNode, FNavigationSearchScratch& Scratch, TArray<int32>& OutPath) const
+{
+	OutPath.Reset();
+	if (!IsBuilt() || !Graph.IsValidNode(FromNode) || !Graph.IsValidNode(ToNode) || Graph.Num() != Width * Height)
+	{
+		return false;
+	}
+
+	// Legs that cross a border are a single step
+	if (HasEdge(Graph, FromNode, ToNode))
+	{
+		OutPath.Add(ToNode);
+		return true;
+	}
+
+	const int32 Cluster = GetCluster(FromNode);
+	if (Cluster != GetCluster(ToNode))
+	{
+		return false;
+	}
+
+	SearchCluster(Graph, FromNode, ToNode, Cluster, Scratch);
+	if (!Scratch.IsClosed(ToNode))
+	{
+		return false;
+	}
+
+	for (int32 Node = ToNode; Node != FromNode; Node = Scratch.CameFrom[Node])
+	{
+		OutPath.Add(Node);
+	}
+	return true;
+}
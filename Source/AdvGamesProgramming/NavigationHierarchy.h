@@ -0,0 +1,111 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NavigationGraph.h"
+
+/**
+Hierarchical pathfinding (HPA*) abstraction over a navigation graph generated from a Width x Height grid.
+The grid is split into square clusters. Entrances are placed where the borders between neighbouring clusters
+can be crossed and the travel cost between every pair of entrances inside a cluster is precomputed. Long
+searches run on the small graph of entrances and each leg is only turned into grid nodes when it is needed.
+*/
+struct ADVGAMESPROGRAMMING_API FNavigationHierarchy
+{
+	void Empty();
+
+	bool IsBuilt() const { return Clusters.Num() > 0; }
+
+	/**
+	Builds the abstraction, only rebuilding the clusters whose nodes or edges changed since the last build.
+	@param Graph - The graph generated from the grid, node N must be the vertex at X = N % Width, Y = N / Width.
+	@param Width - The number of nodes along the X axis.
+	@param Height - The number of nodes along the Y axis.
+	@param ClusterSize - The number of nodes along each side of a cluster.
+	@return The number of clusters that had their entrances and costs rebuilt.
+	*/
+	int32 Build(const FNavigationGraph& Graph, int32 Width, int32 Height, int32 ClusterSize);
+
+	/**
+	Rebuilds the clusters overlapping a region of the grid after its nodes or edges changed, without hashing the rest.
+	@param MinX, MinY, MaxX, MaxY - The inclusive grid coordinates of the changed nodes.
+	@return The number of clusters that had their entrances and costs rebuilt.
+	*/
+	int32 UpdateRegion(const FNavigationGraph& Graph, int32 MinX, int32 MinY, int32 MaxX, int32 MaxY);
+
+	/**
+	Searches the abstract graph for a route between two nodes.
+	@param Scratch - Working memory for the searches inside the start and end clusters, sized for the full graph.
+	@param AbstractScratch - Working memory for the search over the entrances.
+	@param OutWaypoints - Filled with the route in the same format as FNavigationGraph::FindPath. Each waypoint is
+	either in the same cluster as the one before it or is its direct neighbour.
+	@return Whether a route was found.
+	*/
+	bool FindAbstractPath(const FNavigationGraph& Graph, int32 StartNode, int32 EndNode,
+		FNavigationSearchScratch& Scratch, FNavigationSearchScratch& AbstractScratch, TArray<int32>& OutWaypoints) const;
+
+	/**
+	Turns one leg of an abstract route into grid nodes.
+	@return Whether the leg could be refined. OutPath uses the same format as FNavigationGraph::FindPath.
+	*/
+	bool RefineSegment(const FNavigationGraph& Graph, int32 FromNode, int32 ToNode, FNavigationSearchScratch& Scratch, TArray<int32>& OutPath) const;
+
+	int32 GetCluster(int32 Node) const;
+
+private:
+
+	// A pair of neighbouring nodes on either side of a cluster border that the agents can walk between.
+	struct FTransition
+	{
+		int32 NodeA;
+		int32 NodeB;
+		float Cost;
+
+		bool operator==(const FTransition& Other) const { return NodeA == Other.NodeA && NodeB == Other.NodeB && Cost == Other.Cost; }
+	};
+
+	struct FCluster
+	{
+		TArray<int32> Entrances;
+		// Entrances.Num() x Entrances.Num() travel costs inside the cluster, TNumericLimits<float>::Max() if unreachable.
+		TArray<float> IntraCosts;
+		// Checksum of the node positions and edges inside the cluster, used to detect changes.
+		uint32 Hash = 0;
+	};
+
+	int32 Width = 0;
+	int32 Height = 0;
+	int32 ClusterSize = 0;
+	int32 NumClustersX = 0;
+	int32 NumClustersY = 0;
+
+	TArray<FCluster> Clusters;
+	// Transitions between cluster (X, Y) and (X + 1, Y), stored at Y * (NumClustersX - 1) + X.
+	TArray<TArray<FTransition>> VerticalBorders;
+	// Transitions between cluster (X, Y) and (X, Y + 1), stored at Y * NumClustersX + X.
+	TArray<TArray<FTransition>> HorizontalBorders;
+
+	// The flattened abstract graph, one node per entrance with its edges in compressed sparse row form.
+	TArray<int32> AbstractNodes;
+	TMap<int32, int32> BaseToAbstract;
+	TArray<int32> AbstractEdgeOffsets;
+	TArray<int32> AbstractEdgeTargets;
+	TArray<float> AbstractEdgeCosts;
+
+	// Working memory for the searches that measure the costs inside the clusters, kept between builds.
+	FNavigationSearchScratch BuildScratch;
+
+	uint32 HashCluster(const FNavigationGraph& Graph, int32 Cluster) const;
+	// Rebuilds the borders around the changed clusters, the costs of every cluster whose entrances moved and the abstract graph.
+	int32 RebuildClusters(const FNavigationGraph& Graph, const TArray<bool>& ClusterChanged);
+	void BuildBorder(const FNavigationGraph& Graph, int32 ClusterX, int32 ClusterY, bool bVertical, TArray<FTransition>& OutTransitions) const;
+	void BuildClusterCosts(const FNavigationGraph& Graph, int32 Cluster, FNavigationSearchScratch& Scratch);
+	void BuildAbstractGraph();
+
+	/**
+	Searches the graph without leaving the cluster. With a target node it is an A* search that stops at the target,
+	without one it is a Dijkstra search of the whole cluster. The results are left in the scratch.
+	*/
+	void SearchCluster(const FNavigationGraph& Graph, int32 SourceNode, int32 TargetNode, int32 Cluster, FNavigationSearchScratch& Scratch) const;
+};
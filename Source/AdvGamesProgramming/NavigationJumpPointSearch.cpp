@@ -0,0 +1,259 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavigationJumpPointSearch.h"
+
+namespace
+{
+	// The 8 grid directions in clockwise order starting at N. Diagonals have odd indices so the two
+	// cardinal components of diagonal D are D - 1 and D + 1.
+	const FIntPoint DIRECTIONS[8] = {
+		FIntPoint(0, 1), FIntPoint(1, 1), FIntPoint(1, 0), FIntPoint(1, -1),
+		FIntPoint(0, -1), FIntPoint(-1, -1), FIntPoint(-1, 0), FIntPoint(-1, 1)
+	};
+
+	// Maps (DX + 1) + (DY + 1) * 3 to the index in DIRECTIONS, the centre is not a direction.
+	const int32 DIRECTION_LOOKUP[9] = { 5, 4, 3, 6, INDEX_NONE, 2, 7, 0, 1 };
+
+	const uint8 ALL_DIRECTIONS = 0xFF;
+}
+
+void FNavigationJumpPointSearch::Empty()
+{
+	Width = 0;
+	Height = 0;
+	DirectionMasks.Empty();
+	OpenBlocks.Empty();
+}
+
+void FNavigationJumpPointSearch::Build(const FNavigationGraph& Graph, int32 InWidth, int32 InHeight)
+{
+	Empty();
+	if (Graph.Num() == 0 || Graph.Num() != InWidth * InHeight)
+	{
+		return;
+	}
+
+	Width = InWidth;
+	Height = InHeight;
+
+	DirectionMasks.SetNumZeroed(Graph.Num());
+	for (int32 Node = 0; Node < Graph.Num(); Node++)
+	{
+		UpdateDirectionMask(Graph, Node);
+	}
+
+	OpenBlocks.Init(false, Graph.Num());
+	for (int32 Y = 0; Y < Height; Y++)
+	{
+		for (int32 X = 0; X < Width; X++)
+		{
+			UpdateOpenBlock(X, Y);
+		}
+	}
+}
+
+void FNavigationJumpPointSearch::UpdateRegion(const FNavigationGraph& Graph, int32 MinX, int32 MinY, int32 MaxX, int32 MaxY)
+{
+	if (!IsBuilt() || Graph.Num() != DirectionMasks.Num())
+	{
+		return;
+	}
+
+	MinX = FMath::Max(MinX, 0);
+	MinY = FMath::Max(MinY, 0);
+	MaxX = FMath::Min(MaxX, Width - 1);
+	MaxY = FMath::Min(MaxY, Height - 1);
+	for (int32 Y = MinY; Y <= MaxY; Y++)
+	{
+		for (int32 X = MinX; X <= MaxX; X++)
+		{
+			UpdateDirectionMask(Graph, Y * Width + X);
+		}
+	}
+
+	// A block depends on the edges of all 9 of its nodes so the blocks one node outside the region change too
+	for (int32 Y = FMath::Max(MinY - 1, 0); Y <= FMath::Min(MaxY + 1, Height - 1); Y++)
+	{
+		for (int32 X = FMath::Max(MinX - 1, 0); X <= FMath::Min(MaxX + 1, Width - 1); X++)
+		{
+			UpdateOpenBlock(X, Y);
+		}
+	}
+}
+
+void FNavigationJumpPointSearch::UpdateDirectionMask(const FNavigationGraph& Graph, int32 Node)
+{
+	// Record which of the 8 moves the node has an edge for
+	DirectionMasks[Node] = 0;
+	for (int32 Edge = Graph.EdgeOffsets[Node]; Edge < Graph.EdgeOffsets[Node + 1]; Edge++)
+	{
+		const int32 Direction = GetDirection(Node, Graph.EdgeTargets[Edge]);
+		if (Direction != INDEX_NONE && Step(Node, Direction) == Graph.EdgeTargets[Edge])
+		{
+			DirectionMasks[Node] |= 1 << Direction;
+		}
+	}
+}
+
+void FNavigationJumpPointSearch::UpdateOpenBlock(int32 X, int32 Y)
+{
+	// A block is open when every move between two of its nodes is possible. Along the border the nodes that would be
+	// off the map are left out, there is nothing beyond the edge that could force a turn.
+	bool bOpen = true;
+	for (int32 CellY = FMath::Max(Y - 1, 0); CellY <= FMath::Min(Y + 1, Height - 1) && bOpen; CellY++)
+	{
+		for (int32 CellX = FMath::Max(X - 1, 0); CellX <= FMath::Min(X + 1, Width - 1) && bOpen; CellX++)
+		{
+			for (int32 Direction = 0; Direction < 8; Direction++)
+			{
+				const int32 TargetX = CellX + DIRECTIONS[Direction].X;
+				const int32 TargetY = CellY + DIRECTIONS[Direction].Y;
+				if (FMath::Abs(TargetX - X) > 1 || FMath::Abs(TargetY - Y) > 1) continue;
+				if (TargetX < 0 || TargetX >= Width || TargetY < 0 || TargetY >= Height) continue;
+				if (!CanMove(CellY * Width + CellX, Direction))
+				{
+					bOpen = false;
+					break;
+				}
+			}
+		}
+	}
+	OpenBlocks[Y * Width + X] = bOpen;
+}
+
+int32 FNavigationJumpPointSearch::Step(int32 Node, int32 Direction) const
+{
+	return Node + DIRECTIONS[Direction].X + DIRECTIONS[Direction].Y * Width;
+}
+
+int32 FNavigationJumpPointSearch::GetDirection(int32 FromNode, int32 ToNode) const
+{
+	const int32 DX = FMath::Sign(ToNode % Width - FromNode % Width);
+	const int32 DY = FMath::Sign(ToNode / Width - FromNode / Width);
+	return DIRECTION_LOOKUP[(DX + 1) + (DY + 1) * 3];
+}
+
+int32 FNavigationJumpPointSearch::Jump(const FNavigationGraph& Graph, int32 Node, int32 Direction, int32 EndNode, float& OutCost) const
+{
+	const bool bDiagonal = (Direction & 1) != 0;
+	OutCost = 0.0f;
+
+	// The run ends without a jump point when it reaches the edge of the map or a blocked move. A blocked move can only
+	// be reached from a node whose block is not open, and the run always stops on such a node first.
+	int32 CurrentNode = Node;
+	while (CanMove(CurrentNode, Direction))
+	{
+		const int32 NextNode = Step(CurrentNode, Direction);
+		OutCost += FVector::Dist(Graph.Positions[CurrentNode], Graph.Positions[NextNode]);
+
+		// Skipping over a node is only safe when the blocks around it and the node before it are fully open,
+		// otherwise a blocked slope next to the run could force a turn that the pruned expansion would miss.
+		if (NextNode == EndNode || !OpenBlocks[CurrentNode] || !OpenBlocks[NextNode])
+		{
+			return NextNode;
+		}
+
+		// A diagonal move stops wherever one of its straight components would find a jump point
+		if (bDiagonal)
+		{
+			float StraightCost;
+			if (Jump(Graph, NextNode, (Direction + 7) % 8, EndNode, StraightCost) != INDEX_NONE ||
+				Jump(Graph, NextNode, (Direction + 1) % 8, EndNode, StraightCost) != INDEX_NONE)
+			{
+				return NextNode;
+			}
+		}
+
+		CurrentNode = NextNode;
+	}
+	return INDEX_NONE;
+}
+
+bool FNavigationJumpPointSearch::FindPath(const FNavigationGraph& Graph, int32 StartNode, int32 EndNode, FNavigationSearchScratch& Scratch, TArray<int32>& OutPath) const
+{
+	OutPath.Reset();
+	if (!IsBuilt() || !Graph.IsValidNode(StartNode) || !Graph.IsValidNode(EndNode))
+	{
+		return false;
+	}
+
+	Scratch.BeginSearch(Graph.Num());
+
+	const FVector EndPosition = Graph.Positions[EndNode];
+
+	Scratch.Generation[StartNode] = Scratch.CurrentGeneration;
+	Scratch.GScore[StartNode] = 0.0f;
+	Scratch.CameFrom[StartNode] = INDEX_NONE;
+	Scratch.OpenSetPush(StartNode, FVector::Dist(Graph.Positions[StartNode], EndPosition));
+
+	while (Scratch.OpenSet.Num() > 0)
+	{
+		int32 CurrentNode = Scratch.OpenSetPop();
+		Scratch.ClosedGeneration[CurrentNode] = Scratch.CurrentGeneration;
+		Scratch.NumExpanded++;
+
+		if (CurrentNode == EndNode)
+		{
+			// Fill in the nodes between each pair of jump points, they are always in a straight line
+			while (CurrentNode != StartNode)
+			{
+				const int32 ParentNode = Scratch.CameFrom[CurrentNode];
+				const int32 BackDirection = GetDirection(CurrentNode, ParentNode);
+				for (int32 Node = CurrentNode; Node != ParentNode; Node = Step(Node, BackDirection))
+				{
+					OutPath.Add(Node);
+				}
+				CurrentNode = ParentNode;
+			}
+			return true;
+		}
+
+		// Work out which directions need searching from this jump point
+		uint8 SearchDirections = ALL_DIRECTIONS;
+		const int32 ParentNode = Scratch.CameFrom[CurrentNode];
+		if (ParentNode != INDEX_NONE)
+		{
+			const int32 Direction = GetDirection(ParentNode, CurrentNode);
+			const int32 PreviousNode = Step(CurrentNode, (Direction + 4) % 8);
+			if (OpenBlocks[CurrentNode] && OpenBlocks[PreviousNode])
+			{
+				// With everything around open only the natural neighbours can be on a shortest path
+				SearchDirections = 1 << Direction;
+				if (Direction & 1)
+				{
+					SearchDirections |= 1 << ((Direction + 7) % 8);
+					SearchDirections |= 1 << ((Direction + 1) % 8);
+				}
+			}
+		}
+
+		const float CurrentGScore = Scratch.GScore[CurrentNode];
+		for (int32 Direction = 0; Direction < 8; Direction++)
+		{
+			if (!(SearchDirections & (1 << Direction))) continue;
+
+			float JumpCost;
+			const int32 JumpNode = Jump(Graph, CurrentNode, Direction, EndNode, JumpCost);
+			if (JumpNode == INDEX_NONE || Scratch.IsClosed(JumpNode)) continue;
+
+			const float TentativeGScore = CurrentGScore + JumpCost;
+			if (!Scratch.IsVisited(JumpNode))
+			{
+				Scratch.Generation[JumpNode] = Scratch.CurrentGeneration;
+				Scratch.GScore[JumpNode] = TentativeGScore;
+				Scratch.CameFrom[JumpNode] = CurrentNode;
+				Scratch.OpenSetPush(JumpNode, TentativeGScore + FVector::Dist(Graph.Positions[JumpNode], EndPosition));
+			}
+			else if (TentativeGScore < Scratch.GScore[JumpNode])
+			{
+				const float HScore = Scratch.OpenSet[Scratch.HeapIndex[JumpNode]].FScore - Scratch.GScore[JumpNode];
+				Scratch.GScore[JumpNode] = TentativeGScore;
+				Scratch.CameFrom[JumpNode] = CurrentNode;
+				Scratch.OpenSetDecreaseKey(JumpNode, TentativeGScore + HScore);
+			}
+		}
+	}
+
+	return false;
+}
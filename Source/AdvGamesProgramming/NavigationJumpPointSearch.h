@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NavigationGraph.h"
+
+/**
+Jump Point Search over a navigation graph generated from a regular Width x Height grid of vertices with
+8-neighbour connections. Edges removed by the slope test are treated as blocked moves. Straight runs are
+only skipped through nodes whose surrounding 3x3 block has every edge open, every other node becomes a
+jump point and is expanded in all directions, so blocked slopes never hide a route.
+*/
+struct ADVGAMESPROGRAMMING_API FNavigationJumpPointSearch
+{
+	void Empty();
+
+	/**
+	Prepares the grid data needed by the search.
+	@param Graph - The graph generated from the grid, node N must be the vertex at X = N % Width, Y = N / Width.
+	@param Width - The number of nodes along the X axis.
+	@param Height - The number of nodes along the Y axis.
+	*/
+	void Build(const FNavigationGraph& Graph, int32 Width, int32 Height);
+
+	bool IsBuilt() const { return DirectionMasks.Num() > 0; }
+
+	/**
+	Refreshes the grid data after the edges of the nodes inside a region of the grid have changed.
+	@param Graph - The updated graph, it must still have the same Width x Height layout.
+	*/
+	void UpdateRegion(const FNavigationGraph& Graph, int32 MinX, int32 MinY, int32 MaxX, int32 MaxY);
+
+	/**
+	Runs a Jump Point Search between two nodes.
+	@return Whether a path was found. OutPath uses the same format as FNavigationGraph::FindPath and
+	contains every node walked over, not only the jump points.
+	*/
+	bool FindPath(const FNavigationGraph& Graph, int32 StartNode, int32 EndNode, FNavigationSearchScratch& Scratch, TArray<int32>& OutPath) const;
+
+private:
+	int32 Width = 0;
+	int32 Height = 0;
+	// Bit D is set when the node has an edge in Directions[D].
+	TArray<uint8> DirectionMasks;
+	// Whether every edge between the nodes of the 3x3 block centred on the node exists. Positions off the map are not
+	// part of the block, so border nodes are open when the terrain along the edge is.
+	TArray<bool> OpenBlocks;
+
+	void UpdateDirectionMask(const FNavigationGraph& Graph, int32 Node);
+	void UpdateOpenBlock(int32 X, int32 Y);
+	bool CanMove(int32 Node, int32 Direction) const { return (DirectionMasks[Node] & (1 << Direction)) != 0; }
+	int32 Step(int32 Node, int32 Direction) const;
+	int32 GetDirection(int32 FromNode, int32 ToNode) const;
+
+	/**
+	Walks from the node in a straight line until it reaches a jump point.
+	@return The jump point, or INDEX_NONE if the walk was blocked first. OutCost is the length of the walk.
+	*/
+	int32 Jump(const FNavigationGraph& Graph, int32 Node, int32 Direction, int32 EndNode, float& OutCost) const;
+};
@@ -0,0 +1,126 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavigationLandmarks.h"
+#include "Async/ParallelFor.h"
+
+void FNavigationLandmarks::Empty()
+{
+	Landmarks.Empty();
+	Costs.Empty();
+	CostScale = 1.0f;
+}
+
+void FNavigationLandmarks::Build(const FNavigationGraph& Graph, int32 NumLandmarks, bool bInTwoWayEdges, TArray<FNavigationSearchScratch>& Scratch)
+{
+	Empty();
+	bTwoWayEdges = bInTwoWayEdges;
+	if (Graph.Num() == 0 || NumLandmarks <= 0)
+	{
+		return;
+	}
+	if (Scratch.Num() < NumLandmarks)
+	{
+		Scratch.SetNum(NumLandmarks);
+	}
+
+	// Start from the node furthest from an arbitrary node, then keep adding the node furthest from every landmark so far
+	TArray<float> FieldCosts;
+	TArray<float> MinCosts;
+	Graph.BuildCostField(FMath::RandRange(0, Graph.Num() - 1), Scratch[0], MinCosts);
+	while (Landmarks.Num() < FMath::Min(NumLandmarks, Graph.Num()))
+	{
+		int32 FurthestNode = INDEX_NONE;
+		float FurthestCost = -1.0f;
+		for (int32 Node = 0; Node < Graph.Num(); Node++)
+		{
+			if (MinCosts[Node] < TNumericLimits<float>::Max() && MinCosts[Node] > FurthestCost)
+			{
+				FurthestNode = Node;
+				FurthestCost = MinCosts[Node];
+			}
+		}
+		if (FurthestNode == INDEX_NONE || (Landmarks.Num() > 0 && FurthestCost <= 0.0f))
+		{
+			break;
+		}
+		Landmarks.Add(FurthestNode);
+
+		Graph.BuildCostField(FurthestNode, Scratch[0], FieldCosts);
+		for (int32 Node = 0; Node < Graph.Num(); Node++)
+		{
+			MinCosts[Node] = Landmarks.Num() == 1 ? FieldCosts[Node] : FMath::Min(MinCosts[Node], FieldCosts[Node]);
+		}
+	}
+
+	MeasureCosts(Graph, Scratch);
+}
+
+void FNavigationLandmarks::Update(const FNavigationGraph& Graph, TArray<FNavigationSearchScratch>& Scratch)
+{
+	if (IsBuilt())
+	{
+		MeasureCosts(Graph, Scratch);
+	}
+}
+
+void FNavigationLandmarks::MeasureCosts(const FNavigationGraph& Graph, TArray<FNavigationSearchScratch>& Scratch)
+{
+	const int32 NumLandmarks = Landmarks.Num();
+	if (Scratch.Num() < NumLandmarks)
+	{
+		Scratch.SetNum(NumLandmarks);
+	}
+
+	TArray<TArray<float>> Fields;
+	Fields.SetNum(NumLandmarks);
+	ParallelFor(NumLandmarks, [&](int32 Landmark)
+	{
+		Graph.BuildCostField(Landmarks[Landmark], Scratch[Landmark], Fields[Landmark]);
+	});
+
+	// Spread the 16 bit range over the largest finite cost
+	float MaxCost = 0.0f;
+	for (const TArray<float>& Field : Fields)
+	{
+		for (float Cost : Field)
+		{
+			if (Cost < TNumericLimits<float>::Max())
+			{
+				MaxCost = FMath::Max(MaxCost, Cost);
+			}
+		}
+	}
+	CostScale = FMath::Max(MaxCost / (UNREACHABLE - 1), KINDA_SMALL_NUMBER);
+
+	Costs.SetNumUninitialized(Graph.Num() * NumLandmarks);
+	for (int32 Landmark = 0; Landmark < NumLandmarks; Landmark++)
+	{
+		for (int32 Node = 0; Node < Graph.Num(); Node++)
+		{
+			const float Cost = Fields[Landmark][Node];
+			Costs[Node * NumLandmarks + Landmark] = Cost < TNumericLimits<float>::Max()
+				? uint16(FMath::Min(FMath::FloorToInt(Cost / CostScale), UNREACHABLE - 1))
+				: UNREACHABLE;
+		}
+	}
+}
+
+float FNavigationLandmarks::GetLowerBound(int32 Node, int32 EndNode) const
+{
+	const int32 NumLandmarks = Landmarks.Num();
+	const uint16* NodeCosts = &Costs[Node * NumLandmarks];
+	const uint16* EndCosts = &Costs[EndNode * NumLandmarks];
+
+	int32 BestSteps = 0;
+	for (int32 Landmark = 0; Landmark < NumLandmarks; Landmark++)
+	{
+		if (NodeCosts[Landmark] == UNREACHABLE || EndCosts[Landmark] == UNREACHABLE) continue;
+
+		const int32 Steps = int32(EndCosts[Landmark]) - int32(NodeCosts[Landmark]);
+		BestSteps = FMath::Max(BestSteps, bTwoWayEdges ? FMath::Abs(Steps) : Steps);
+	}
+
+	// Each stored cost was rounded down by less than a step, so one step is taken off to keep the bound below the true cost
+	return FMath::Max(BestSteps - 1, 0) * CostScale;
+}
@@ -0,0 +1,56 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NavigationGraph.h"
+
+/**
+Precomputed travel costs from a few landmark nodes to every node, used for the ALT (A*, landmarks and the triangle
+inequality) heuristic. If L is a landmark then the cost from N to E is at least Cost(L, E) - Cost(L, N), and on
+graphs where every edge is two way also Cost(L, N) - Cost(L, E). Unlike the straight line distance this accounts
+for the detours forced by edges removed by the slope test, so far fewer nodes are expanded on hilly maps.
+Costs are quantised to 16 bits, stored node by node so one lookup reads all the landmarks of a node together.
+*/
+class ADVGAMESPROGRAMMING_API FNavigationLandmarks
+{
+public:
+	void Empty();
+
+	/**
+	Picks the landmarks and measures the costs from them. Each landmark after the first is the node furthest from
+	the ones already picked, which spreads them around the edges of the map where they give the tightest bounds.
+	@param Graph - The graph to measure.
+	@param NumLandmarks - The number of landmarks to pick.
+	@param bInTwoWayEdges - Whether every edge has a matching edge back, which allows the bound in both directions.
+	@param Scratch - The working memory used by the searches, one per landmark so they can run in parallel.
+	*/
+	void Build(const FNavigationGraph& Graph, int32 NumLandmarks, bool bInTwoWayEdges, TArray<FNavigationSearchScratch>& Scratch);
+
+	/**
+	Measures the costs from the landmarks already picked again after the edges of the graph have changed.
+	*/
+	void Update(const FNavigationGraph& Graph, TArray<FNavigationSearchScratch>& Scratch);
+
+	bool IsBuilt() const { return Landmarks.Num() > 0; }
+	int32 Num() const { return Landmarks.Num(); }
+
+	/**
+	@return A lower bound on the travel cost from a node to the end node, zero if no landmark reaches both.
+	*/
+	float GetLowerBound(int32 Node, int32 EndNode) const;
+
+private:
+	// Marks nodes a landmark cannot reach.
+	static const uint16 UNREACHABLE = MAX_uint16;
+
+	TArray<int32> Landmarks;
+	// The quantised cost from landmark L to node N is at Costs[N * Landmarks.Num() + L].
+	TArray<uint16> Costs;
+	// The cost each quantisation step stands for. Costs are rounded down when stored.
+	float CostScale = 1.0f;
+	bool bTwoWayEdges = false;
+
+	// Runs a Dijkstra search from every landmark in parallel and stores the quantised results.
+	void MeasureCosts(const FNavigationGraph& Graph, TArray<FNavigationSearchScratch>& Scratch);
+};
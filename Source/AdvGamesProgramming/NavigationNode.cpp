@@ -7,11 +7,13 @@
 // Sets default values
 ANavigationNode::ANavigationNode()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+ 	// Nodes are only an editable and debug view of the navigation graph so they never need to tick.
+	PrimaryActorTick.bCanEverTick = false;
 
 	LocationComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Location Component"));
 	RootComponent = LocationComponent;
+
+	NodeIndex = INDEX_NONE;
 }
 
 // Called when the game starts or when spawned
@@ -33,8 +35,3 @@ void ANavigationNode::Tick(float DeltaTime)
 
 }
 
-float ANavigationNode::FScore()
-{
-	return GScore + HScore;
-}
-
@@ -25,13 +25,11 @@ public:
 	TArray<ANavigationNode*> ConnectedNodes;
 	USceneComponent* LocationComponent;
 
-	float GScore;
-	float HScore;
-	ANavigationNode* CameFrom;
+	// Index of this node in the AI managers navigation graph. Pathfinding runs on that graph,
+	// this actor is only the editable and debug view of the node.
+	int32 NodeIndex;
 
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
-	float FScore();
-
 };
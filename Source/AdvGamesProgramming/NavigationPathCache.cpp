@@ -0,0 +1,116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavigationPathCache.h"
+
+void FNavigationPathCache::SetCapacity(int32 NewCapacity)
+{
+	Capacity = FMath::Max(NewCapacity, 0);
+	Empty();
+	Entries.Reserve(Capacity);
+}
+
+void FNavigationPathCache::Empty()
+{
+	Entries.Reset();
+	KeyToEntry.Reset();
+	EntriesByEndNode.Reset();
+}
+
+int32 FNavigationPathCache::RemovePathsThrough(TFunctionRef<bool(int32)> IsChangedNode)
+{
+	TArray<FEntry> KeptEntries;
+	for (FEntry& Entry : Entries)
+	{
+		if (!IsChangedNode(Entry.StartNode) && !Entry.Path.ContainsByPredicate(IsChangedNode))
+		{
+			KeptEntries.Add(MoveTemp(Entry));
+		}
+	}
+
+	// The kept entries are packed again so the lookups are rebuilt to match their new slots
+	const int32 NumRemoved = Entries.Num() - KeptEntries.Num();
+	Empty();
+	for (FEntry& Entry : KeptEntries)
+	{
+		const int32 EntryIndex = Entries.Add(MoveTemp(Entry));
+		KeyToEntry.Add(MakeKey(Entries[EntryIndex].StartNode, Entries[EntryIndex].EndNode), EntryIndex);
+		EntriesByEndNode.FindOrAdd(Entries[EntryIndex].EndNode).Add(EntryIndex);
+	}
+	return NumRemoved;
+}
+
+FNavigationPathCache::ELookupResult FNavigationPathCache::Find(int32 StartNode, int32 EndNode, TArray<int32>& OutPath)
+{
+	if (const int32* EntryIndex = KeyToEntry.Find(MakeKey(StartNode, EndNode)))
+	{
+		FEntry& Entry = Entries[*EntryIndex];
+		Entry.LastUsed = ++UseCounter;
+		OutPath = Entry.Path;
+		return ELookupResult::Hit;
+	}
+
+	// Paths are stored from the end node backwards, so the part of a path still to walk
+	// from one of its nodes is everything before that node in the array.
+	if (const TArray<int32>* EndEntries = EntriesByEndNode.Find(EndNode))
+	{
+		for (int32 EntryIndex : *EndEntries)
+		{
+			FEntry& Entry = Entries[EntryIndex];
+			const int32 StartIndex = Entry.Path.Find(StartNode);
+			if (StartIndex != INDEX_NONE)
+			{
+				Entry.LastUsed = ++UseCounter;
+				OutPath.Reset(StartIndex);
+				OutPath.Append(Entry.Path.GetData(), StartIndex);
+				return ELookupResult::SuffixHit;
+			}
+		}
+	}
+
+	return ELookupResult::Miss;
+}
+
+void FNavigationPathCache::Add(int32 StartNode, int32 EndNode, const TArray<int32>& Path)
+{
+	const uint64 Key = MakeKey(StartNode, EndNode);
+	if (Capacity == 0 || Path.Num() == 0 || KeyToEntry.Contains(Key))
+	{
+		return;
+	}
+
+	int32 EntryIndex;
+	if (Entries.Num() < Capacity)
+	{
+		EntryIndex = Entries.AddDefaulted();
+	}
+	else
+	{
+		// Reuse the slot of the least recently used path
+		EntryIndex = 0;
+		for (int32 i = 1; i < Entries.Num(); i++)
+		{
+			if (Entries[i].LastUsed < Entries[EntryIndex].LastUsed)
+			{
+				EntryIndex = i;
+			}
+		}
+
+		FEntry& Evicted = Entries[EntryIndex];
+		KeyToEntry.Remove(MakeKey(Evicted.StartNode, Evicted.EndNode));
+		TArray<int32>& EndEntries = EntriesByEndNode.FindChecked(Evicted.EndNode);
+		EndEntries.RemoveSingleSwap(EntryIndex);
+		if (EndEntries.Num() == 0)
+		{
+			EntriesByEndNode.Remove(Evicted.EndNode);
+		}
+	}
+
+	FEntry& Entry = Entries[EntryIndex];
+	Entry.StartNode = StartNode;
+	Entry.EndNode = EndNode;
+	Entry.Path = Path;
+	Entry.LastUsed = ++UseCounter;
+	KeyToEntry.Add(Key, EntryIndex);
+	EntriesByEndNode.FindOrAdd(EndNode).Add(EntryIndex);
+}
@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+Least recently used cache of paths keyed by their start and end node.
+A query also hits when its start node lies on a cached path to the same end node, in which case the
+remaining part of that path is returned.
+*/
+struct ADVGAMESPROGRAMMING_API FNavigationPathCache
+{
+	enum class ELookupResult : uint8
+	{
+		Miss,
+		Hit,
+		SuffixHit
+	};
+
+	// Sets the maximum number of cached paths and empties the cache. A capacity of zero disables caching.
+	void SetCapacity(int32 NewCapacity);
+	int32 GetCapacity() const { return Capacity; }
+	int32 Num() const { return KeyToEntry.Num(); }
+
+	// Drops every cached path, called whenever the navigation graph is built again.
+	void Empty();
+
+	/**
+	Drops the cached paths that start at or visit a changed node, called when only part of the graph changes.
+	The other paths stay walkable, although a shortcut opened by the change is only taken once they are evicted.
+	@param IsChangedNode - Whether the edges of a node changed.
+	@return The number of paths dropped.
+	*/
+	int32 RemovePathsThrough(TFunctionRef<bool(int32)> IsChangedNode);
+
+	/**
+	@param OutPath - Filled with the cached path in the same format as AAIManager::GeneratePath on a hit.
+	*/
+	ELookupResult Find(int32 StartNode, int32 EndNode, TArray<int32>& OutPath);
+	void Add(int32 StartNode, int32 EndNode, const TArray<int32>& Path);
+
+private:
+	struct FEntry
+	{
+		int32 StartNode;
+		int32 EndNode;
+		TArray<int32> Path;
+		uint64 LastUsed;
+	};
+
+	int32 Capacity = 0;
+	uint64 UseCounter = 0;
+	TArray<FEntry> Entries;
+	TMap<uint64, int32> KeyToEntry;
+	// The entries for every end node, used to find paths a new start node lies on.
+	TMap<int32, TArray<int32>> EntriesByEndNode;
+
+	static uint64 MakeKey(int32 StartNode, int32 EndNode) { return (uint64(uint32(StartNode)) << 32) | uint32(EndNode); }
+};
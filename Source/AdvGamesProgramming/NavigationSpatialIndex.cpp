@@ -0,0 +1,278 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NavigationSpatialIndex.h"
+
+namespace
+{
+	// Roughly how many nodes should share a bucket for graphs that are not a regular grid.
+	const float NODES_PER_BUCKET = 4.0f;
+	// The number of grid cells along each side of a bucket for graphs that are a regular grid.
+	const int32 GRID_CELLS_PER_BUCKET = 8;
+	// Upper limit on the number of buckets along each axis.
+	const int32 MAX_BUCKETS_PER_AXIS = 1024;
+
+	// The axes used to find the extreme nodes, the nodes with the lowest and highest projection on each are kept.
+	const FVector EXTREME_AXES[] = {
+		FVector(1.0f, 0.0f, 0.0f), FVector(0.0f, 1.0f, 0.0f), FVector(0.0f, 0.0f, 1.0f),
+		FVector(1.0f, 1.0f, 0.0f), FVector(1.0f, -1.0f, 0.0f), FVector(1.0f, 0.0f, 1.0f),
+		FVector(1.0f, 0.0f, -1.0f), FVector(0.0f, 1.0f, 1.0f), FVector(0.0f, 1.0f, -1.0f),
+		FVector(1.0f, 1.0f, 1.0f), FVector(1.0f, 1.0f, -1.0f), FVector(1.0f, -1.0f, 1.0f),
+		FVector(1.0f, -1.0f, -1.0f)
+	};
+
+	// The largest squared distance from the location to any point inside the box.
+	float MaxDistSquaredToBox(const FBox& Box, const FVector& Location)
+	{
+		const float DX = FMath::Max(FMath::Abs(Location.X - Box.Min.X), FMath::Abs(Location.X - Box.Max.X));
+		const float DY = FMath::Max(FMath::Abs(Location.Y - Box.Min.Y), FMath::Abs(Location.Y - Box.Max.Y));
+		const float DZ = FMath::Max(FMath::Abs(Location.Z - Box.Min.Z), FMath::Abs(Location.Z - Box.Max.Z));
+		return DX * DX + DY * DY + DZ * DZ;
+	}
+}
+
+void FNavigationSpatialIndex::Empty()
+{
+	bIsRegularGrid = false;
+	GridWidth = 0;
+	GridHeight = 0;
+	NumBucketsX = 0;
+	NumBucketsY = 0;
+	BucketOffsets.Empty();
+	BucketNodes.Empty();
+	BucketBounds.Empty();
+	ExtremeNodes.Empty();
+}
+
+void FNavigationSpatialIndex::Build(const TArray<FVector>& Positions)
+{
+	Empty();
+	if (Positions.Num() == 0)
+	{
+		return;
+	}
+
+	// Size the buckets so each one holds a handful of nodes on average
+	FBox Bounds(Positions);
+	const float Area = FMath::Max(Bounds.GetSize().X * Bounds.GetSize().Y, 1.0f);
+	BuildBuckets(Positions, FMath::Sqrt(Area * NODES_PER_BUCKET / Positions.Num()));
+}
+
+void FNavigationSpatialIndex::BuildForGrid(const TArray<FVector>& Positions, int32 Width, int32 Height)
+{
+	Empty();
+	if (Width < 2 || Height < 2 || Positions.Num() != Width * Height)
+	{
+		Build(Positions);
+		return;
+	}
+
+	GridWidth = Width;
+	GridHeight = Height;
+	GridOrigin = FVector2D(Positions[0]);
+	GridSpacing = FVector2D(Positions[1].X - Positions[0].X, Positions[Width].Y - Positions[0].Y);
+	bIsRegularGrid = !FMath::IsNearlyZero(GridSpacing.X) && !FMath::IsNearlyZero(GridSpacing.Y);
+
+	// The buckets are still needed for the furthest node query
+	BuildBuckets(Positions, FMath::Max(FMath::Abs(GridSpacing.X), FMath::Abs(GridSpacing.Y)) * GRID_CELLS_PER_BUCKET);
+}
+
+void FNavigationSpatialIndex::UpdateHeights(const TArray<FVector>& Positions, const TArray<int32>& Nodes)
+{
+	if (BucketBounds.Num() == 0)
+	{
+		return;
+	}
+
+	// The nodes stay in the same buckets. The furthest node query only needs the bounds to contain every node in
+	// the bucket, so they are grown and never shrunk. The extreme nodes are only a starting guess and can stay as they are.
+	for (int32 Node : Nodes)
+	{
+		const FIntPoint Coords = GetBucketCoords(Positions[Node]);
+		BucketBounds[Coords.Y * NumBucketsX + Coords.X] += Positions[Node];
+	}
+}
+
+void FNavigationSpatialIndex::BuildBuckets(const TArray<FVector>& Positions, float CellSize)
+{
+	FBox Bounds(Positions);
+	const FVector Size = Bounds.GetSize();
+	BucketOrigin = FVector2D(Bounds.Min);
+	BucketSize = FMath::Max3(CellSize, Size.X / MAX_BUCKETS_PER_AXIS, Size.Y / MAX_BUCKETS_PER_AXIS);
+	BucketSize = FMath::Max(BucketSize, KINDA_SMALL_NUMBER);
+	NumBucketsX = FMath::FloorToInt(Size.X / BucketSize) + 1;
+	NumBucketsY = FMath::FloorToInt(Size.Y / BucketSize) + 1;
+	const int32 NumBuckets = NumBucketsX * NumBucketsY;
+
+	// Count the nodes per bucket then lay them out contiguously
+	TArray<int32> NodeBuckets;
+	NodeBuckets.SetNumUninitialized(Positions.Num());
+	BucketOffsets.SetNumZeroed(NumBuckets + 1);
+	for (int32 Node = 0; Node < Positions.Num(); Node++)
+	{
+		const FIntPoint Coords = GetBucketCoords(Positions[Node]);
+		NodeBuckets[Node] = Coords.Y * NumBucketsX + Coords.X;
+		BucketOffsets[NodeBuckets[Node] + 1]++;
+	}
+	for (int32 Bucket = 0; Bucket < NumBuckets; Bucket++)
+	{
+		BucketOffsets[Bucket + 1] += BucketOffsets[Bucket];
+	}
+
+	TArray<int32> InsertPositions(BucketOffsets.GetData(), NumBuckets);
+	BucketNodes.SetNumUninitialized(Positions.Num());
+	BucketBounds.Init(FBox(ForceInit), NumBuckets);
+	for (int32 Node = 0; Node < Positions.Num(); Node++)
+	{
+		BucketNodes[InsertPositions[NodeBuckets[Node]]++] = Node;
+		BucketBounds[NodeBuckets[Node]] += Positions[Node];
+	}
+
+	// Keep the nodes at both ends of every extreme axis
+	for (const FVector& Axis : EXTREME_AXES)
+	{
+		int32 MinNode = 0;
+		int32 MaxNode = 0;
+		float MinProjection = TNumericLimits<float>::Max();
+		float MaxProjection = TNumericLimits<float>::Lowest();
+		for (int32 Node = 0; Node < Positions.Num(); Node++)
+		{
+			const float Projection = FVector::DotProduct(Positions[Node], Axis);
+			if (Projection < MinProjection)
+			{
+				MinProjection = Projection;
+				MinNode = Node;
+			}
+			if (Projection > MaxProjection)
+			{
+				MaxProjection = Projection;
+				MaxNode = Node;
+			}
+		}
+		ExtremeNodes.AddUnique(MinNode);
+		ExtremeNodes.AddUnique(MaxNode);
+	}
+}
+
+FIntPoint FNavigationSpatialIndex::GetBucketCoords(const FVector& Location) const
+{
+	return FIntPoint(
+		FMath::Clamp(FMath::FloorToInt((Location.X - BucketOrigin.X) / BucketSize), 0, NumBucketsX - 1),
+		FMath::Clamp(FMath::FloorToInt((Location.Y - BucketOrigin.Y) / BucketSize), 0, NumBucketsY - 1));
+}
+
+int32 FNavigationSpatialIndex::FindNearest(const TArray<FVector>& Positions, const FVector& Location) const
+{
+	if (Positions.Num() == 0 || BucketNodes.Num() != Positions.Num())
+	{
+		return INDEX_NONE;
+	}
+	return bIsRegularGrid ? FindNearestInGrid(Positions, Location) : FindNearestInBuckets(Positions, Location);
+}
+
+int32 FNavigationSpatialIndex::FindNearestInGrid(const TArray<FVector>& Positions, const FVector& Location) const
+{
+	// Find the grid vertex the location is closest to in the XY plane
+	const int32 CentreX = FMath::Clamp(FMath::RoundToInt((Location.X - GridOrigin.X) / GridSpacing.X), 0, GridWidth - 1);
+	const int32 CentreY = FMath::Clamp(FMath::RoundToInt((Location.Y - GridOrigin.Y) / GridSpacing.Y), 0, GridHeight - 1);
+
+	// Then compare the full 3D distance against its neighbours to account for the terrain height
+	int32 NearestNode = INDEX_NONE;
+	float NearestDistSquared = TNumericLimits<float>::Max();
+	for (int32 Y = FMath::Max(CentreY - 1, 0); Y <= FMath::Min(CentreY + 1, GridHeight - 1); Y++)
+	{
+		for (int32 X = FMath::Max(CentreX - 1, 0); X <= FMath::Min(CentreX + 1, GridWidth - 1); X++)
+		{
+			const int32 Node = Y * GridWidth + X;
+			const float DistSquared = FVector::DistSquared(Location, Positions[Node]);
+			if (DistSquared < NearestDistSquared)
+			{
+				NearestDistSquared = DistSquared;
+				NearestNode = Node;
+			}
+		}
+	}
+	return NearestNode;
+}
+
+int32 FNavigationSpatialIndex::FindNearestInBuckets(const TArray<FVector>& Positions, const FVector& Location) const
+{
+	const FIntPoint Centre = GetBucketCoords(Location);
+	const int32 MaxRing = FMath::Max(NumBucketsX, NumBucketsY);
+
+	int32 NearestNode = INDEX_NONE;
+	float NearestDistSquared = TNumericLimits<float>::Max();
+
+	// Search rings of buckets outwards from the bucket containing the location
+	for (int32 Ring = 0; Ring <= MaxRing; Ring++)
+	{
+		// Every bucket in this ring is at least this far away so nothing closer can be found
+		const float RingDistance = FMath::Max(Ring - 1, 0) * BucketSize;
+		if (NearestNode != INDEX_NONE && RingDistance * RingDistance >= NearestDistSquared) break;
+
+		for (int32 Y = Centre.Y - Ring; Y <= Centre.Y + Ring; Y++)
+		{
+			if (Y < 0 || Y >= NumBucketsY) continue;
+			// Only the first and last rows of the ring are walked in full
+			const bool bEdgeRow = Y == Centre.Y - Ring || Y == Centre.Y + Ring;
+			const int32 Step = bEdgeRow || Ring == 0 ? 1 : Ring * 2;
+			for (int32 X = Centre.X - Ring; X <= Centre.X + Ring; X += Step)
+			{
+				if (X < 0 || X >= NumBucketsX) continue;
+				const int32 Bucket = Y * NumBucketsX + X;
+				if (BucketOffsets[Bucket] == BucketOffsets[Bucket + 1]) continue;
+				if (BucketBounds[Bucket].ComputeSquaredDistanceToPoint(Location) >= NearestDistSquared) continue;
+
+				for (int32 i = BucketOffsets[Bucket]; i < BucketOffsets[Bucket + 1]; i++)
+				{
+					const float DistSquared = FVector::DistSquared(Location, Positions[BucketNodes[i]]);
+					if (DistSquared < NearestDistSquared)
+					{
+						NearestDistSquared = DistSquared;
+						NearestNode = BucketNodes[i];
+					}
+				}
+			}
+		}
+	}
+	return NearestNode;
+}
+
+int32 FNavigationSpatialIndex::FindFurthest(const TArray<FVector>& Positions, const FVector& Location) const
+{
+	if (Positions.Num() == 0 || BucketNodes.Num() != Positions.Num())
+	{
+		return INDEX_NONE;
+	}
+
+	// Start from the extreme nodes, which are normally where the answer is
+	int32 FurthestNode = INDEX_NONE;
+	float FurthestDistSquared = -1.0f;
+	for (int32 Node : ExtremeNodes)
+	{
+		const float DistSquared = FVector::DistSquared(Location, Positions[Node]);
+		if (DistSquared > FurthestDistSquared)
+		{
+			FurthestDistSquared = DistSquared;
+			FurthestNode = Node;
+		}
+	}
+
+	// Only look inside buckets that could hold a node further away than the best so far
+	for (int32 Bucket = 0; Bucket < BucketBounds.Num(); Bucket++)
+	{
+		if (BucketOffsets[Bucket] == BucketOffsets[Bucket + 1]) continue;
+		if (MaxDistSquaredToBox(BucketBounds[Bucket], Location) <= FurthestDistSquared) continue;
+
+		for (int32 i = BucketOffsets[Bucket]; i < BucketOffsets[Bucket + 1]; i++)
+		{
+			const float DistSquared = FVector::DistSquared(Location, Positions[BucketNodes[i]]);
+			if (DistSquared > FurthestDistSquared)
+			{
+				FurthestDistSquared = DistSquared;
+				FurthestNode = BucketNodes[i];
+			}
+		}
+	}
+	return FurthestNode;
+}
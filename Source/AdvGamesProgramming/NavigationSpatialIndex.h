@@ -0,0 +1,67 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+Spatial lookup of navigation nodes for nearest and furthest node queries.
+Nodes are bucketed into a uniform grid over the XY plane. Graphs generated from a Width x Height grid of
+vertices are also indexed directly so the nearest node is found from the cell the location falls in.
+*/
+struct ADVGAMESPROGRAMMING_API FNavigationSpatialIndex
+{
+	void Empty();
+
+	/**
+	Builds the index for nodes in any arrangement, such as hand placed nodes.
+	@param Positions - The location of every node.
+	*/
+	void Build(const TArray<FVector>& Positions);
+	/**
+	Builds the index for nodes laid out as a regular Width x Height grid, stored row by row.
+	@param Positions - The location of every node.
+	@param Width - The number of nodes along the X axis.
+	@param Height - The number of nodes along the Y axis.
+	*/
+	void BuildForGrid(const TArray<FVector>& Positions, int32 Width, int32 Height);
+
+	/**
+	Keeps the index valid after some nodes have moved up or down. Nodes that moved across the XY plane need a full rebuild.
+	@param Positions - The location of every node, including the moved ones.
+	@param Nodes - The nodes that moved.
+	*/
+	void UpdateHeights(const TArray<FVector>& Positions, const TArray<int32>& Nodes);
+
+	// Both queries take the same positions the index was built from and return INDEX_NONE when there are no nodes.
+	int32 FindNearest(const TArray<FVector>& Positions, const FVector& Location) const;
+	int32 FindFurthest(const TArray<FVector>& Positions, const FVector& Location) const;
+
+private:
+
+	// Regular grid lookup, only valid when bIsRegularGrid is set.
+	bool bIsRegularGrid = false;
+	int32 GridWidth = 0;
+	int32 GridHeight = 0;
+	FVector2D GridOrigin;
+	FVector2D GridSpacing;
+
+	// Uniform buckets over the XY bounds of the nodes. The nodes in bucket B are
+	// BucketNodes[BucketOffsets[B]] up to BucketNodes[BucketOffsets[B + 1] - 1].
+	FVector2D BucketOrigin;
+	float BucketSize = 1.0f;
+	int32 NumBucketsX = 0;
+	int32 NumBucketsY = 0;
+	TArray<int32> BucketOffsets;
+	TArray<int32> BucketNodes;
+	TArray<FBox> BucketBounds;
+
+	// The nodes that are furthest along a fixed set of directions. One of these is usually the furthest node
+	// from any location so they give a tight starting distance for pruning buckets.
+	TArray<int32> ExtremeNodes;
+
+	void BuildBuckets(const TArray<FVector>& Positions, float CellSize);
+	FIntPoint GetBucketCoords(const FVector& Location) const;
+	int32 FindNearestInGrid(const TArray<FVector>& Positions, const FVector& Location) const;
+	int32 FindNearestInBuckets(const TArray<FVector>& Positions, const FVector& Location) const;
+};
@@ -5,6 +5,7 @@
 #include "Engine/World.h"
 #include "Pickup.h"
 #include "Engine/Engine.h"
+#include "ProcedurallyGeneratedMap.h"
 
 
 // Sets default values
@@ -13,19 +14,55 @@ APickupManager::APickupManager()
  	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
 
+	ProceduralMap = nullptr;
 }
 
-void APickupManager::Init(const TArray<FVector>& PossibleSpawnLocationsArg, TSubclassOf<APickup> WeaponPickupClassArg, float SpawnIntervalArg)
+void APickupManager::Init(AProcedurallyGeneratedMap* ProceduralMapArg, TSubclassOf<APickup> WeaponPickupClassArg, float SpawnIntervalArg)
 {
-	this->PossibleSpawnLocations = PossibleSpawnLocationsArg;
+	this->ProceduralMap = ProceduralMapArg;
 	this->WeaponPickupClass = WeaponPickupClassArg;
 	this->SpawnInterval = SpawnIntervalArg;
+
+	// Share the map's heightfield and follow it when it changes rather than keeping a copy of the vertices
+	Terrain = ProceduralMap->GetTerrainSnapshot();
+	ProceduralMap->OnTerrainSnapshotPublished.AddUObject(this, &APickupManager::OnTerrainSnapshotPublished);
+}
+
+void APickupManager::OnTerrainSnapshotPublished(FTerrainSnapshotRef NewTerrain)
+{
+	Terrain = NewTerrain;
 }
 
 void APickupManager::SpawnWeaponPickup()
 {
-	int32 RandomLocation = FMath::RandRange(0, PossibleSpawnLocations.Num() - 1);
-	APickup* WeaponPickup = GetWorld()->SpawnActor<APickup>(WeaponPickupClass, PossibleSpawnLocations[RandomLocation] + FVector(0.0f,0.0f,50.0f), FRotator::ZeroRotator);
+	if (!Terrain.IsValid() || Terrain->Num() == 0)
+	{
+		return;
+	}
+
+	// Any point on the map will do, the hover height is measured from the interpolated surface under it
+	const FVector2D RandomLocation(
+		FMath::FRandRange(0.0f, (Terrain->GetGridWidth() - 1) * Terrain->GetGridSize()),
+		FMath::FRandRange(0.0f, (Terrain->GetGridHeight() - 1) * Terrain->GetGridSize()));
+	// The snapshot is in the map's local space, so the surface point is moved into the world before hovering above it
+	const FVector LocalSurface(RandomLocation, Terrain->GetHeightAt(RandomLocation));
+	const FVector Surface = ProceduralMap ? ProceduralMap->GetActorTransform().TransformPosition(LocalSurface) : LocalSurface;
+	const FVector Location = Surface + FVector(0.0f, 0.0f, PICKUP_HOVER_HEIGHT);
+
+	// Hold the pickup back until the terrain under it can be collided with
+	if (ProceduralMap && !ProceduralMap->HasCollisionAt(Location))
+	{
+		ProceduralMap->RequestCollisionAt(Location, COLLISION_REQUEST_DURATION);
+		PendingSpawnLocations.Add(Location);
+		return;
+	}
+
+	SpawnWeaponPickupAt(Location);
+}
+
+void APickupManager::SpawnWeaponPickupAt(const FVector& Location)
+{
+	APickup* WeaponPickup = GetWorld()->SpawnActor<APickup>(WeaponPickupClass, Location, FRotator::ZeroRotator);
 	WeaponPickup->SetLifeSpan(PICKUP_LIFETIME);
 
 	if (GEngine)
@@ -48,5 +85,19 @@ void APickupManager::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	for (int32 i = PendingSpawnLocations.Num() - 1; i >= 0; i--)
+	{
+		if (!ProceduralMap || ProceduralMap->HasCollisionAt(PendingSpawnLocations[i]))
+		{
+			SpawnWeaponPickupAt(PendingSpawnLocations[i]);
+			PendingSpawnLocations.RemoveAtSwap(i);
+		}
+		else
+		{
+			// Keep the collision request alive in case cooking takes longer than the request lasts
+			ProceduralMap->RequestCollisionAt(PendingSpawnLocations[i], COLLISION_REQUEST_DURATION);
+		}
+	}
+
 }
 
@@ -5,6 +5,7 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "TimerManager.h"
+#include "TerrainSnapshot.h"
 #include "PickupManager.generated.h"
 
 
@@ -17,20 +18,30 @@ class ADVGAMESPROGRAMMING_API APickupManager : public AActor
 private:
 
 	const float PICKUP_LIFETIME = 20.0f;
+	// How far above the terrain surface pickups are spawned.
+	const float PICKUP_HOVER_HEIGHT = 50.0f;
+	// How long the terrain keeps collision around a pickup that is waiting to spawn.
+	const float COLLISION_REQUEST_DURATION = 5.0f;
 
-	TArray<FVector> PossibleSpawnLocations;
+	// The terrain the pickups are spawned on.
+	FTerrainSnapshotPtr Terrain;
 	TSubclassOf<class APickup> WeaponPickupClass;
 	float SpawnInterval;
 	FTimerHandle WeaponSpawnTimer;
+	class AProcedurallyGeneratedMap* ProceduralMap;
+	// Locations chosen for pickups that are waiting for the terrain collision under them to be cooked.
+	TArray<FVector> PendingSpawnLocations;
 
 	void SpawnWeaponPickup();
+	void SpawnWeaponPickupAt(const FVector& Location);
+	void OnTerrainSnapshotPublished(FTerrainSnapshotRef NewTerrain);
 
 public:	
 
 	// Sets default values for this actor's properties
 	APickupManager();
 
-	void Init(const TArray<FVector>& PossibleSpawnLocationsArg, 
+	void Init(class AProcedurallyGeneratedMap* ProceduralMapArg, 
 				TSubclassOf<APickup> WeaponPickupClassArg, 
 				float SpawnIntervalArg);
 
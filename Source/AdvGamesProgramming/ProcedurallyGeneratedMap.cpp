@@ -2,7 +2,13 @@
 
 
 #include "ProcedurallyGeneratedMap.h"
-#include "KismetProceduralMeshLibrary.h"
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/Pawn.h"
+#include "EngineUtils.h"
+#include "Net/UnrealNetwork.h"
+#include "TerrainCache.h"
 #include "AIManager.h"
 
 // Sets default values
@@ -12,9 +18,38 @@ AProcedurallyGeneratedMap::AProcedurallyGeneratedMap()
 	PrimaryActorTick.bCanEverTick = true;
 
 	MeshComponent = CreateDefaultSubobject<UProceduralMeshComponent>(TEXT("Mesh Component"));
+	// Cook collision off the game thread, the previous collision is used until the new one is ready
+	MeshComponent->bUseAsyncCooking = true;
+
+	// Only the small generation descriptor is replicated, the mesh is generated on every machine
+	bReplicates = true;
+	bAlwaysRelevant = true;
 
 	PerlinScale = 1000.0f;
 	PerlinRoughness = 0.1f;
+	NoiseType = TerrainNoiseType::FBM;
+	PerlinOctaves = 1;
+	PerlinLacunarity = 2.0f;
+	PerlinPersistence = 0.5f;
+	DomainWarpStrength = 0.0f;
+	Seed = 0;
+	bRandomizeSeed = false;
+	bGenerateOnMatchStart = false;
+	bUseTerrainCache = true;
+	ChunkSize = 32;
+	bStreamChunks = false;
+	ChunkStreamingDistance = 20000.0f;
+	MaxChunkLoadsPerFrame = 2;
+	NumLODs = 4;
+	LODDistance = 5000.0f;
+	ChunkCollisionDistance = 5000.0f;
+	SkirtDepth = 200.0f;
+	NumChunksX = 0;
+	NumChunksY = 0;
+	NumLoadedChunks = 0;
+	ChunkLayoutSize = 0;
+	TerrainGeneration = 0;
+	NumAppliedDeformations = 0;
 	bRegenerateMap = false;
 }
 
@@ -50,6 +85,22 @@ void AProcedurallyGeneratedMap::BeginPlay()
 
 	//GenerateMap();
 
+	// The chunks saved with the level are rebuilt from the heightfield so their detail level and collision can be managed
+	if (Vertices.Num() > 0 && Vertices.Num() == Width * Height)
+	{
+		// The normals are not saved with the level
+		if (Normals.Num() != Vertices.Num())
+		{
+			UpdateNormals(0, 0, Width - 1, Height - 1);
+		}
+		InitialiseChunks();
+		MeshComponent->ClearAllMeshSections();
+		// Without streaming everything starts at full detail and is reduced once the players have been found
+		if (!bStreamChunks)
+		{
+			LoadAllChunks();
+		}
+	}
 }
 
 // Called every frame
@@ -59,10 +110,15 @@ void AProcedurallyGeneratedMap::Tick(float DeltaTime)
 
 	if (bRegenerateMap)
 	{
-		ClearMap();
+		// GenerateMap only throws the mesh away when the layout of the grid has changed
 		GenerateMap();
 		bRegenerateMap = false;
 	}
+
+	if (GetWorld()->IsGameWorld())
+	{
+		UpdateChunks();
+	}
 }
 
 bool AProcedurallyGeneratedMap::ShouldTickIfViewportsOnly() const
@@ -72,44 +128,899 @@ bool AProcedurallyGeneratedMap::ShouldTickIfViewportsOnly() const
 
 void AProcedurallyGeneratedMap::GenerateMap()
 {
-	float PerlinOffset = FMath::RandRange(-10000.0f, 10000.0f);
-	for (int32 Y = 0; Y < Height; Y++)
+	if (bRandomizeSeed)
+	{
+		Seed = FMath::Rand();
+	}
+
+	FTerrainGenerationDescriptor Descriptor = MakeDescriptor();
+	GenerateFromDescriptor(Descriptor);
+	// Edits made to the old terrain do not carry over
+	Deformations.Empty();
+	NumAppliedDeformations = 0;
+
+	// Replicating the descriptor with the checksum of the result lets the clients generate and check the same map
+	Descriptor.Checksum = CalculateChecksum();
+	GenerationDescriptor = Descriptor;
+}
+
+void AProcedurallyGeneratedMap::PrepareForMatch()
+{
+	if (bGenerateOnMatchStart || Vertices.Num() == 0 || Vertices.Num() != Width * Height)
+	{
+		GenerateMap();
+		return;
+	}
+
+	// The designed terrain is kept. Clients loading the same level already match the checksum and skip generating it.
+	FTerrainGenerationDescriptor Descriptor = MakeDescriptor();
+	Descriptor.Checksum = CalculateChecksum();
+	GenerationDescriptor = Descriptor;
+}
+
+FTerrainGenerationDescriptor AProcedurallyGeneratedMap::MakeDescriptor() const
+{
+	FTerrainGenerationDescriptor Descriptor;
+	Descriptor.Seed = Seed;
+	Descriptor.Width = Width;
+	Descriptor.Height = Height;
+	Descriptor.GridSize = GridSize;
+	Descriptor.NoiseType = NoiseType;
+	Descriptor.Octaves = PerlinOctaves;
+	Descriptor.Frequency = PerlinRoughness;
+	Descriptor.Amplitude = PerlinScale;
+	Descriptor.Lacunarity = PerlinLacunarity;
+	Descriptor.Persistence = PerlinPersistence;
+	Descriptor.DomainWarpStrength = DomainWarpStrength;
+	return Descriptor;
+}
+
+void AProcedurallyGeneratedMap::OnRep_GenerationDescriptor()
+{
+	// A client that loaded the same terrain with the level already has the server's map
+	if (Vertices.Num() != GenerationDescriptor.Width * GenerationDescriptor.Height || CalculateChecksum() != GenerationDescriptor.Checksum)
+	{
+		GenerateFromDescriptor(GenerationDescriptor);
+
+		const uint32 Checksum = CalculateChecksum();
+		if (Checksum != GenerationDescriptor.Checksum)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Generated terrain does not match the server, checksum %08x expected %08x"), Checksum, GenerationDescriptor.Checksum)
+		}
+	}
+
+	// The heights are the freshly generated ones again, so every edit is applied from the start
+	NumAppliedDeformations = 0;
+	ApplyPendingDeformations();
+}
+
+void AProcedurallyGeneratedMap::OnRep_Deformations()
+{
+	// The server may have generated a new map with no edits yet, which the new descriptor deals with
+	if (NumAppliedDeformations > Deformations.Num())
+	{
+		return;
+	}
+	ApplyPendingDeformations();
+}
+
+void AProcedurallyGeneratedMap::ApplyPendingDeformations()
+{
+	// A client that joined late has no terrain until the descriptor arrives, the edits are applied after it is generated
+	if (Vertices.Num() == 0 || Vertices.Num() != GenerationDescriptor.Width * GenerationDescriptor.Height)
+	{
+		return;
+	}
+
+	for (; NumAppliedDeformations < Deformations.Num(); NumAppliedDeformations++)
+	{
+		const FTerrainDeformation& Deformation = Deformations[NumAppliedDeformations];
+		uint32 Checksum = 0;
+		if (ApplyDeformation(Deformation, Checksum) && Checksum != Deformation.Checksum)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Deformed terrain does not match the server, checksum %08x expected %08x"), Checksum, Deformation.Checksum)
+		}
+	}
+}
+
+void AProcedurallyGeneratedMap::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(AProcedurallyGeneratedMap, GenerationDescriptor);
+	DOREPLIFETIME(AProcedurallyGeneratedMap, Deformations);
+}
+
+uint32 AProcedurallyGeneratedMap::CalculateChecksum() const
+{
+	// The X and Y of every vertex come straight from the grid so only the heights are checked
+	TArray<float> Heights;
+	Heights.SetNumUninitialized(Vertices.Num());
+	for (int32 i = 0; i < Vertices.Num(); i++)
 	{
-		for (int32 X = 0; X < Width; X++)
+		Heights[i] = Vertices[i].Z;
+	}
+	return FCrc::MemCrc32(Heights.GetData(), Heights.Num() * sizeof(float));
+}
+
+void AProcedurallyGeneratedMap::GenerateFromDescriptor(const FTerrainGenerationDescriptor& Descriptor)
+{
+	// Keep the properties in step with the descriptor so a client ends up with the same settings as the server
+	Seed = Descriptor.Seed;
+	Width = Descriptor.Width;
+	Height = Descriptor.Height;
+	GridSize = Descriptor.GridSize;
+	NoiseType = Descriptor.NoiseType;
+	PerlinOctaves = Descriptor.Octaves;
+	PerlinRoughness = Descriptor.Frequency;
+	PerlinScale = Descriptor.Amplitude;
+	PerlinLacunarity = Descriptor.Lacunarity;
+	PerlinPersistence = Descriptor.Persistence;
+	DomainWarpStrength = Descriptor.DomainWarpStrength;
+
+	const bool bUpdateInPlace = CanUpdateInPlace();
+
+	const bool bLoadedFromCache = bUseTerrainCache && LoadFromCache(Descriptor);
+	if (!bLoadedFromCache)
+	{
+		FTerrainNoiseSettings NoiseSettings;
+		NoiseSettings.NoiseType = Descriptor.NoiseType;
+		NoiseSettings.Seed = Descriptor.Seed;
+		NoiseSettings.Octaves = Descriptor.Octaves;
+		NoiseSettings.Frequency = Descriptor.Frequency;
+		NoiseSettings.Amplitude = Descriptor.Amplitude;
+		NoiseSettings.Lacunarity = Descriptor.Lacunarity;
+		NoiseSettings.Persistence = Descriptor.Persistence;
+		NoiseSettings.DomainWarpStrength = Descriptor.DomainWarpStrength;
+		const FTerrainNoise Noise(Descriptor.Seed);
+
+		Vertices.SetNumUninitialized(Width * Height);
+		ParallelFor(Height, [&](int32 Y)
 		{
-			float Z = FMath::PerlinNoise2D(FVector2D(X * PerlinRoughness + PerlinOffset, Y * PerlinRoughness + PerlinOffset)) * PerlinScale;
-			Vertices.Add(FVector(X * GridSize, Y * GridSize, Z));
-			UVCoords.Add(FVector2D(X, Y));
+			// A whole row of heights is generated at once so the noise can be evaluated several samples at a time
+			TArray<float> RowHeights;
+			RowHeights.SetNumUninitialized(Width);
+			Noise.GenerateRow(NoiseSettings, Y, Width, RowHeights.GetData());
 
-			if (X != Width - 1 && Y != Height - 1)
+			for (int32 X = 0; X < Width; X++)
 			{
-				Triangles.Add(Y * Width + X);
-				Triangles.Add((Y + 1) * Width + X);
-				Triangles.Add(Y * Width + X + 1);
-				Triangles.Add(Y * Width + X + 1);
-				Triangles.Add((Y + 1) * Width + X);
-				Triangles.Add((Y + 1) * Width + X + 1);
+				Vertices[Y * Width + X] = FVector(X * GridSize, Y * GridSize, RowHeights[X]);
 			}
+		});
+
+		// The heights are all known now so the normals can come straight from the heightfield gradient
+		UpdateNormals(0, 0, Width - 1, Height - 1);
+	}
+
+	if (bUpdateInPlace)
+	{
+		// Only the heights changed so the sections keep their triangles and UVs and just get new positions and normals
+		RefreshChunks(0, 0, Width - 1, Height - 1);
+	}
+	else
+	{
+		InitialiseChunks();
+		MeshComponent->ClearAllMeshSections();
+		if (!bStreamChunks || !GetWorld()->IsGameWorld())
+		{
+			LoadAllChunks();
+		}
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("Vertices Count: %i | Chunk Count: %i | Loaded Chunk Count: %i"), Vertices.Num(), Chunks.Num(), NumLoadedChunks)
+
+	PublishTerrainSnapshot();
+
+	// The AI only runs where the map has authority. A graph loaded from the cache is used instead of testing every connection again.
+	if (AIManager && HasAuthority() && !bLoadedFromCache)
+	{
+		AIManager->GenerateNodes(*TerrainSnapshot);
+	}
+
+	// A random seed will not come up again so there is no point writing its terrain out
+	if (bUseTerrainCache && !bLoadedFromCache && !bRandomizeSeed)
+	{
+		SaveToCache(Descriptor);
+	}
+}
+
+FTerrainCacheKey AProcedurallyGeneratedMap::MakeCacheKey(const FTerrainGenerationDescriptor& Descriptor) const
+{
+	FTerrainCacheKey Key;
+	Key.Seed = Descriptor.Seed;
+	Key.Width = Descriptor.Width;
+	Key.Height = Descriptor.Height;
+	Key.GridSize = Descriptor.GridSize;
+	Key.NoiseType = int32(Descriptor.NoiseType);
+	Key.Octaves = Descriptor.Octaves;
+	Key.Frequency = Descriptor.Frequency;
+	Key.Amplitude = Descriptor.Amplitude;
+	Key.Lacunarity = Descriptor.Lacunarity;
+	Key.Persistence = Descriptor.Persistence;
+	Key.DomainWarpStrength = Descriptor.DomainWarpStrength;
+	// Only the machine running the AI needs the graph so it is part of the key there
+	Key.NavigationAllowedAngle = AIManager && HasAuthority() ? AIManager->AllowedAngle : -1.0f;
+	return Key;
+}
+
+bool AProcedurallyGeneratedMap::LoadFromCache(const FTerrainGenerationDescriptor& Descriptor)
+{
+	const FTerrainCacheKey Key = MakeCacheKey(Descriptor);
+	FTerrainCacheData CacheData;
+	if (!FTerrainCache::Load(Key, CacheData) || (Key.NavigationAllowedAngle >= 0.0f && CacheData.NavigationGraph.Num() != CacheData.Vertices.Num()))
+	{
+		return false;
+	}
+
+	Vertices = MoveTemp(CacheData.Vertices);
+	Normals = MoveTemp(CacheData.Normals);
+	if (AIManager && HasAuthority())
+	{
+		AIManager->SetNavigationGraph(CacheData.NavigationGraph, Width, Height);
+	}
+	UE_LOG(LogTemp, Display, TEXT("Loaded terrain from %s"), *FTerrainCache::GetCachePath(Key))
+	return true;
+}
+
+void AProcedurallyGeneratedMap::SaveToCache(const FTerrainGenerationDescriptor& Descriptor) const
+{
+	const FTerrainCacheKey Key = MakeCacheKey(Descriptor);
+	FTerrainCacheData CacheData;
+	CacheData.Vertices = Vertices;
+	CacheData.Normals = Normals;
+	if (Key.NavigationAllowedAngle >= 0.0f)
+	{
+		CacheData.NavigationGraph = AIManager->GetNavigationGraph();
+	}
+	FTerrainCache::Save(Key, CacheData);
+}
+
+FVector AProcedurallyGeneratedMap::CalculateNormal(int32 X, int32 Y) const
+{
+	// Central differences inside the grid and one sided differences along its edges
+	const int32 Left = FMath::Max(X - 1, 0);
+	const int32 Right = FMath::Min(X + 1, Width - 1);
+	const int32 Down = FMath::Max(Y - 1, 0);
+	const int32 Up = FMath::Min(Y + 1, Height - 1);
+
+	const float DZDX = Right != Left ? (Vertices[Y * Width + Right].Z - Vertices[Y * Width + Left].Z) / ((Right - Left) * GridSize) : 0.0f;
+	const float DZDY = Up != Down ? (Vertices[Up * Width + X].Z - Vertices[Down * Width + X].Z) / ((Up - Down) * GridSize) : 0.0f;
+
+	return FVector(-DZDX, -DZDY, 1.0f).GetSafeNormal();
+}
+
+void AProcedurallyGeneratedMap::UpdateNormals(int32 MinX, int32 MinY, int32 MaxX, int32 MaxY)
+{
+	Normals.SetNumUninitialized(Vertices.Num());
+	MinX = FMath::Max(MinX, 0);
+	MinY = FMath::Max(MinY, 0);
+	MaxX = FMath::Min(MaxX, Width - 1);
+	MaxY = FMath::Min(MaxY, Height - 1);
+	if (MinX > MaxX || MinY > MaxY)
+	{
+		return;
+	}
+
+	ParallelFor(MaxY - MinY + 1, [&](int32 Row)
+	{
+		const int32 Y = MinY + Row;
+		for (int32 X = MinX; X <= MaxX; X++)
+		{
+			Normals[Y * Width + X] = CalculateNormal(X, Y);
 		}
+	});
+}
+
+FTerrainSnapshotPtr AProcedurallyGeneratedMap::GetTerrainSnapshot()
+{
+	// A map loaded with the level has vertices but has not published them yet
+	if (!TerrainSnapshot.IsValid() && Vertices.Num() > 0 && Vertices.Num() == Width * Height)
+	{
+		PublishTerrainSnapshot();
+	}
+	return TerrainSnapshot;
+}
+
+float AProcedurallyGeneratedMap::GetHeightAt(const FVector& Location) const
+{
+	if (!TerrainSnapshot.IsValid())
+	{
+		return GetActorLocation().Z;
+	}
+	const FVector LocalLocation = GetActorTransform().InverseTransformPosition(Location);
+	const float LocalHeight = TerrainSnapshot->GetHeightAt(FVector2D(LocalLocation));
+	return GetActorTransform().TransformPosition(FVector(LocalLocation.X, LocalLocation.Y, LocalHeight)).Z;
+}
+
+FVector AProcedurallyGeneratedMap::GetNormalAt(const FVector& Location) const
+{
+	if (!TerrainSnapshot.IsValid())
+	{
+		return GetActorUpVector();
+	}
+	const FVector LocalLocation = GetActorTransform().InverseTransformPosition(Location);
+	return GetActorTransform().TransformVectorNoScale(TerrainSnapshot->GetNormalAt(FVector2D(LocalLocation)));
+}
+
+float AProcedurallyGeneratedMap::GetSlopeAt(const FVector& Location) const
+{
+	if (!TerrainSnapshot.IsValid())
+	{
+		return 0.0f;
+	}
+	const FVector LocalLocation = GetActorTransform().InverseTransformPosition(Location);
+	return TerrainSnapshot->GetSlopeAt(FVector2D(LocalLocation));
+}
+
+void AProcedurallyGeneratedMap::GetHeightsAt(const TArray<FVector>& Locations, TArray<float>& OutHeights) const
+{
+	OutHeights.SetNumUninitialized(Locations.Num());
+	for (int32 i = 0; i < Locations.Num(); i++)
+	{
+		OutHeights[i] = GetHeightAt(Locations[i]);
+	}
+}
+
+void AProcedurallyGeneratedMap::GetNormalsAt(const TArray<FVector>& Locations, TArray<FVector>& OutNormals) const
+{
+	OutNormals.SetNumUninitialized(Locations.Num());
+	for (int32 i = 0; i < Locations.Num(); i++)
+	{
+		OutNormals[i] = GetNormalAt(Locations[i]);
+	}
+}
+
+void AProcedurallyGeneratedMap::GetSlopesAt(const TArray<FVector>& Locations, TArray<float>& OutSlopes) const
+{
+	OutSlopes.SetNumUninitialized(Locations.Num());
+	for (int32 i = 0; i < Locations.Num(); i++)
+	{
+		OutSlopes[i] = GetSlopeAt(Locations[i]);
 	}
+}
 
-	UKismetProceduralMeshLibrary::CalculateTangentsForMesh(Vertices, Triangles, UVCoords, Normals, Tangents);
+bool AProcedurallyGeneratedMap::HasLineOfSight(const FVector& Start, const FVector& End) const
+{
+	if (!TerrainSnapshot.IsValid())
+	{
+		return true;
+	}
+	const FTransform& Transform = GetActorTransform();
+	return FTerrainLineOfSight::HasLineOfSight(*TerrainSnapshot, Transform.InverseTransformPosition(Start), Transform.InverseTransformPosition(End));
+}
 
-	MeshComponent->CreateMeshSection(0, Vertices, Triangles, Normals, UVCoords, TArray<FColor>(), Tangents, true);
+void AProcedurallyGeneratedMap::HasLineOfSightBatch(const TArray<FLineOfSightQuery>& Queries, TArray<bool>& OutVisible, bool bUseWorkerThreads) const
+{
+	if (!TerrainSnapshot.IsValid())
+	{
+		OutVisible.Init(true, Queries.Num());
+		return;
+	}
+
+	const FTransform& Transform = GetActorTransform();
+	TArray<FLineOfSightQuery> LocalQueries;
+	LocalQueries.Reserve(Queries.Num());
+	for (const FLineOfSightQuery& Query : Queries)
+	{
+		LocalQueries.Emplace(Transform.InverseTransformPosition(Query.Start), Transform.InverseTransformPosition(Query.End));
+	}
+	FTerrainLineOfSight::HasLineOfSightBatch(*TerrainSnapshot, LocalQueries, OutVisible, bUseWorkerThreads);
+}
 
-	UE_LOG(LogTemp, Warning, TEXT("Vertices Count: %i | UVCoords Count: %i | Triangles Count: %i"), Vertices.Num(), UVCoords.Num(), Triangles.Num())
+void AProcedurallyGeneratedMap::PublishTerrainSnapshot()
+{
+	// Consumers still holding the previous snapshot keep it alive until they let go of it
+	FTerrainSnapshotRef NewSnapshot = MakeShared<const FTerrainSnapshot, ESPMode::ThreadSafe>(Vertices, Width, Height, GridSize, ++TerrainGeneration);
+	TerrainSnapshot = NewSnapshot;
+	OnTerrainSnapshotPublished.Broadcast(NewSnapshot);
+}
 
-	if (AIManager)
+void AProcedurallyGeneratedMap::PublishTerrainSnapshot(int32 MinX, int32 MinY, int32 MaxX, int32 MaxY)
+{
+	if (!TerrainSnapshot.IsValid() || TerrainSnapshot->GetGridWidth() != Width || TerrainSnapshot->GetGridHeight() != Height
+		|| TerrainSnapshot->GetGridSize() != GridSize)
 	{
-		AIManager->GenerateNodes(Vertices, Width, Height);
+		PublishTerrainSnapshot();
+		return;
 	}
+
+	FTerrainSnapshotRef NewSnapshot = MakeShared<const FTerrainSnapshot, ESPMode::ThreadSafe>(*TerrainSnapshot, Vertices, MinX, MinY, MaxX, MaxY, ++TerrainGeneration);
+	TerrainSnapshot = NewSnapshot;
+	OnTerrainSnapshotPublished.Broadcast(NewSnapshot);
 }
 
 void AProcedurallyGeneratedMap::ClearMap()
 {
-	Triangles.Empty();
+	TerrainSnapshot.Reset();
 	Vertices.Empty();
-	UVCoords.Empty();
+	Normals.Empty();
+	NumAppliedDeformations = 0;
+	if (HasAuthority())
+	{
+		Deformations.Empty();
+	}
+	Chunks.Empty();
+	ChunkIndexBuffers.Empty();
+	NumChunksX = 0;
+	NumChunksY = 0;
+	NumLoadedChunks = 0;
+	ChunkLayoutSize = 0;
 	MeshComponent->ClearAllMeshSections();
 }
 
+void AProcedurallyGeneratedMap::UpdateRegion(int32 MinX, int32 MinY, int32 MaxX, int32 MaxY)
+{
+	if (Vertices.Num() != Width * Height || Width < 2 || Height < 2)
+	{
+		return;
+	}
+
+	MinX = FMath::Clamp(MinX, 0, Width - 1);
+	MinY = FMath::Clamp(MinY, 0, Height - 1);
+	MaxX = FMath::Clamp(MaxX, 0, Width - 1);
+	MaxY = FMath::Clamp(MaxY, 0, Height - 1);
+
+	// The normals of the vertices around the region are worked out from the changed heights as well
+	UpdateNormals(MinX - 1, MinY - 1, MaxX + 1, MaxY + 1);
+	RefreshChunks(MinX - 1, MinY - 1, MaxX + 1, MaxY + 1);
+
+	PublishTerrainSnapshot(MinX, MinY, MaxX, MaxY);
+
+	if (AIManager && HasAuthority())
+	{
+		AIManager->UpdateNodes(*TerrainSnapshot, MinX, MinY, MaxX, MaxY);
+	}
+}
+
+void AProcedurallyGeneratedMap::DeformTerrain(const FVector& Location, float Radius, float Depth)
+{
+	// Clients get the edit through Deformations, changing only their own copy would leave them out of step
+	if (!HasAuthority() || Vertices.Num() != Width * Height || Radius <= 0.0f || GridSize <= 0.0f)
+	{
+		return;
+	}
+
+	FTerrainDeformation Deformation;
+	Deformation.Location = FVector2D(GetActorTransform().InverseTransformPosition(Location));
+	Deformation.Radius = Radius;
+	Deformation.Depth = Depth;
+	if (ApplyDeformation(Deformation, Deformation.Checksum))
+	{
+		Deformations.Add(Deformation);
+		NumAppliedDeformations = Deformations.Num();
+	}
+}
+
+bool AProcedurallyGeneratedMap::ApplyDeformation(const FTerrainDeformation& Deformation, uint32& OutChecksum)
+{
+	const FVector2D& LocalLocation = Deformation.Location;
+	const float Radius = Deformation.Radius;
+	const int32 MinX = FMath::Max(FMath::FloorToInt((LocalLocation.X - Radius) / GridSize), 0);
+	const int32 MinY = FMath::Max(FMath::FloorToInt((LocalLocation.Y - Radius) / GridSize), 0);
+	const int32 MaxX = FMath::Min(FMath::CeilToInt((LocalLocation.X + Radius) / GridSize), Width - 1);
+	const int32 MaxY = FMath::Min(FMath::CeilToInt((LocalLocation.Y + Radius) / GridSize), Height - 1);
+	if (MinX > MaxX || MinY > MaxY)
+	{
+		return false;
+	}
+
+	// Only the heights of the region go into the checksum so checking an edit costs as little as making it
+	OutChecksum = 0;
+	for (int32 Y = MinY; Y <= MaxY; Y++)
+	{
+		for (int32 X = MinX; X <= MaxX; X++)
+		{
+			FVector& Vertex = Vertices[Y * Width + X];
+			const float DistanceSquared = FVector2D::DistSquared(FVector2D(Vertex), LocalLocation);
+			if (DistanceSquared < Radius * Radius)
+			{
+				const float Falloff = 1.0f - DistanceSquared / (Radius * Radius);
+				Vertex.Z -= Deformation.Depth * Falloff * Falloff;
+			}
+			OutChecksum = FCrc::MemCrc32(&Vertex.Z, sizeof(float), OutChecksum);
+		}
+	}
+
+	UpdateRegion(MinX, MinY, MaxX, MaxY);
+	return true;
+}
+
+bool AProcedurallyGeneratedMap::HasCollisionAt(const FVector& Location)
+{
+	// Without any chunks there is no terrain to wait for
+	if (Chunks.Num() == 0)
+	{
+		return true;
+	}
+
+	// Trace straight through the location against the terrain only, the hit only happens once the chunk's collision is cooked
+	const FVector Up = GetActorUpVector() * HALF_WORLD_MAX;
+	FHitResult Hit;
+	return MeshComponent->LineTraceComponent(Hit, Location + Up, Location - Up, FCollisionQueryParams(SCENE_QUERY_STAT(TerrainCollisionCheck)));
+}
+
+void AProcedurallyGeneratedMap::RequestCollisionAt(const FVector& Location, float Duration)
+{
+	const FVector LocalLocation = GetActorTransform().InverseTransformPosition(Location);
+	const float ExpiryTime = GetWorld()->GetTimeSeconds() + Duration;
+	for (FCollisionRequest& Request : CollisionRequests)
+	{
+		if (FVector::PointsAreNear(Request.LocalLocation, LocalLocation, GridSize))
+		{
+			Request.ExpiryTime = FMath::Max(Request.ExpiryTime, ExpiryTime);
+			return;
+		}
+	}
+	CollisionRequests.Add({ LocalLocation, ExpiryTime });
+}
+
+bool AProcedurallyGeneratedMap::CanUpdateInPlace() const
+{
+	return Chunks.Num() > 0 && ChunkLayoutSize == ChunkSize && Vertices.Num() == Width * Height
+		&& NumChunksX == FMath::DivideAndRoundUp(Width - 1, FMath::Max(ChunkSize, 1))
+		&& NumChunksY == FMath::DivideAndRoundUp(Height - 1, FMath::Max(ChunkSize, 1));
+}
+
+void AProcedurallyGeneratedMap::RefreshChunks(int32 MinX, int32 MinY, int32 MaxX, int32 MaxY)
+{
+	TArray<int32> ChunksToRefresh;
+	for (int32 ChunkIndex = 0; ChunkIndex < Chunks.Num(); ChunkIndex++)
+	{
+		const FTerrainChunk& Chunk = Chunks[ChunkIndex];
+		if (Chunk.LOD != INDEX_NONE
+			&& Chunk.FirstX <= MaxX && Chunk.FirstX + Chunk.NumX - 1 >= MinX
+			&& Chunk.FirstY <= MaxY && Chunk.FirstY + Chunk.NumY - 1 >= MinY)
+		{
+			ChunksToRefresh.Add(ChunkIndex);
+		}
+	}
+
+	TArray<FTerrainChunkMeshData> MeshData;
+	MeshData.SetNum(ChunksToRefresh.Num());
+	ParallelFor(ChunksToRefresh.Num(), [&](int32 i)
+	{
+		BuildChunkMeshData(ChunksToRefresh[i], Chunks[ChunksToRefresh[i]].LOD, MeshData[i]);
+	});
+
+	// Empty arrays leave the UVs and vertex colours of the section as they are
+	for (int32 i = 0; i < ChunksToRefresh.Num(); i++)
+	{
+		MeshComponent->UpdateMeshSection(ChunksToRefresh[i], MeshData[i].Vertices, MeshData[i].Normals, TArray<FVector2D>(), TArray<FColor>(), MeshData[i].Tangents);
+	}
+}
+
+void AProcedurallyGeneratedMap::InitialiseChunks()
+{
+	Chunks.Reset();
+	ChunkIndexBuffers.Reset();
+	NumLoadedChunks = 0;
+	if (Width < 2 || Height < 2)
+	{
+		NumChunksX = 0;
+		NumChunksY = 0;
+		return;
+	}
+
+	ChunkLayoutSize = ChunkSize;
+	const int32 CellsPerChunk = FMath::Max(ChunkSize, 1);
+	NumChunksX = FMath::DivideAndRoundUp(Width - 1, CellsPerChunk);
+	NumChunksY = FMath::DivideAndRoundUp(Height - 1, CellsPerChunk);
+	Chunks.Reserve(NumChunksX * NumChunksY);
+
+	for (int32 ChunkY = 0; ChunkY < NumChunksY; ChunkY++)
+	{
+		for (int32 ChunkX = 0; ChunkX < NumChunksX; ChunkX++)
+		{
+			FTerrainChunk Chunk;
+			Chunk.FirstX = ChunkX * CellsPerChunk;
+			Chunk.FirstY = ChunkY * CellsPerChunk;
+			Chunk.NumX = FMath::Min(CellsPerChunk, Width - 1 - Chunk.FirstX) + 1;
+			Chunk.NumY = FMath::Min(CellsPerChunk, Height - 1 - Chunk.FirstY) + 1;
+			Chunk.LOD = INDEX_NONE;
+			Chunk.bCollision = false;
+			Chunks.Add(Chunk);
+
+			// Only the chunks along the far edges can be smaller so there are at most four different sizes
+			for (int32 LOD = 0; LOD < FMath::Max(NumLODs, 1); LOD++)
+			{
+				const FIntVector Key(Chunk.NumX, Chunk.NumY, LOD);
+				if (!ChunkIndexBuffers.Contains(Key))
+				{
+					BuildChunkIndexBuffer(Chunk.NumX, Chunk.NumY, LOD, ChunkIndexBuffers.Add(Key));
+				}
+			}
+		}
+	}
+}
+
+void AProcedurallyGeneratedMap::LoadAllChunks()
+{
+	// Every chunk only reads the shared heightfield so they can all be built at the same time
+	TArray<FTerrainChunkMeshData> MeshData;
+	MeshData.SetNum(Chunks.Num());
+	ParallelFor(Chunks.Num(), [&](int32 ChunkIndex)
+	{
+		BuildChunkMeshData(ChunkIndex, 0, MeshData[ChunkIndex]);
+	});
+
+	// Mesh sections can only be created on the game thread
+	for (int32 ChunkIndex = 0; ChunkIndex < Chunks.Num(); ChunkIndex++)
+	{
+		LoadChunk(ChunkIndex, 0, true, MeshData[ChunkIndex]);
+	}
+}
+
+void AProcedurallyGeneratedMap::UpdateChunks()
+{
+	if (Chunks.Num() == 0)
+	{
+		return;
+	}
+
+	// Players decide what is loaded and at what detail, every pawn including the AI needs ground to stand on
+	TArray<FVector> PlayerLocations;
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		APlayerController* PlayerController = It->Get();
+		if (PlayerController && PlayerController->GetPawn())
+		{
+			PlayerLocations.Add(GetActorTransform().InverseTransformPosition(PlayerController->GetPawn()->GetActorLocation()));
+		}
+	}
+	TArray<FVector> PawnLocations;
+	for (TActorIterator<APawn> It(GetWorld()); It; ++It)
+	{
+		PawnLocations.Add(GetActorTransform().InverseTransformPosition(It->GetActorLocation()));
+	}
+	const float CurrentTime = GetWorld()->GetTimeSeconds();
+	CollisionRequests.RemoveAll([CurrentTime](const FCollisionRequest& Request) { return Request.ExpiryTime < CurrentTime; });
+	for (const FCollisionRequest& Request : CollisionRequests)
+	{
+		PawnLocations.Add(Request.LocalLocation);
+	}
+
+	// Anything that is switched off is only switched off a chunk further out than it was switched on so it does not flicker
+	const float Hysteresis = ChunkSize * GridSize;
+
+	struct FChunkUpdate
+	{
+		int32 ChunkIndex;
+		int32 LOD;
+		bool bCollision;
+		float Distance;
+	};
+	TArray<FChunkUpdate> ChunkUpdates;
+
+	for (int32 ChunkIndex = 0; ChunkIndex < Chunks.Num(); ChunkIndex++)
+	{
+		const FTerrainChunk& Chunk = Chunks[ChunkIndex];
+
+		float PlayerDistance = TNumericLimits<float>::Max();
+		for (const FVector& PlayerLocation : PlayerLocations)
+		{
+			PlayerDistance = FMath::Min(PlayerDistance, GetDistanceToChunk(ChunkIndex, PlayerLocation));
+		}
+		float PawnDistance = TNumericLimits<float>::Max();
+		for (const FVector& PawnLocation : PawnLocations)
+		{
+			PawnDistance = FMath::Min(PawnDistance, GetDistanceToChunk(ChunkIndex, PawnLocation));
+		}
+
+		const bool bLoaded = Chunk.LOD != INDEX_NONE;
+		const bool bCollision = PawnDistance <= ChunkCollisionDistance + (Chunk.bCollision ? Hysteresis : 0.0f);
+		if (bStreamChunks && !bCollision && PlayerDistance > ChunkStreamingDistance + (bLoaded ? Hysteresis : 0.0f))
+		{
+			if (bLoaded)
+			{
+				UnloadChunk(ChunkIndex);
+			}
+			continue;
+		}
+
+		int32 LOD = 0;
+		if (!bCollision)
+		{
+			LOD = GetLODForDistance(PlayerDistance);
+			// Coming closer raises the detail straight away but it is only lowered once the player is a little past the boundary
+			if (bLoaded && LOD > Chunk.LOD)
+			{
+				LOD = FMath::Max(Chunk.LOD, GetLODForDistance(PlayerDistance - Hysteresis));
+			}
+		}
+
+		if (LOD != Chunk.LOD || bCollision != Chunk.bCollision)
+		{
+			ChunkUpdates.Add({ ChunkIndex, LOD, bCollision, bCollision ? PawnDistance : PlayerDistance });
+		}
+	}
+
+	// Collision that a pawn is waiting on comes first, then the closest chunks, the rest are spread over the following frames
+	ChunkUpdates.Sort([this](const FChunkUpdate& A, const FChunkUpdate& B)
+	{
+		const bool bAUrgent = A.bCollision && !Chunks[A.ChunkIndex].bCollision;
+		const bool bBUrgent = B.bCollision && !Chunks[B.ChunkIndex].bCollision;
+		if (bAUrgent != bBUrgent)
+		{
+			return bAUrgent;
+		}
+		return A.Distance < B.Distance;
+	});
+
+	const int32 NumToLoad = FMath::Min(ChunkUpdates.Num(), FMath::Max(MaxChunkLoadsPerFrame, 1));
+	for (int32 i = 0; i < NumToLoad; i++)
+	{
+		FTerrainChunkMeshData MeshData;
+		BuildChunkMeshData(ChunkUpdates[i].ChunkIndex, ChunkUpdates[i].LOD, MeshData);
+		LoadChunk(ChunkUpdates[i].ChunkIndex, ChunkUpdates[i].LOD, ChunkUpdates[i].bCollision, MeshData);
+	}
+}
+
+int32 AProcedurallyGeneratedMap::GetLODForDistance(float Distance) const
+{
+	const int32 MaxLOD = FMath::Max(NumLODs, 1) - 1;
+	if (LODDistance <= 0.0f)
+	{
+		return 0;
+	}
+	return FMath::Clamp(FMath::FloorToInt(FMath::Min(Distance / LODDistance, float(MaxLOD))), 0, MaxLOD);
+}
+
+void AProcedurallyGeneratedMap::GetLODCoordinates(int32 NumVertices, int32 LOD, TArray<int32>& OutCoordinates)
+{
+	const int32 Step = 1 << LOD;
+	OutCoordinates.Reset();
+	for (int32 Coordinate = 0; Coordinate < NumVertices - 1; Coordinate += Step)
+	{
+		OutCoordinates.Add(Coordinate);
+	}
+	OutCoordinates.Add(NumVertices - 1);
+}
+
+void AProcedurallyGeneratedMap::GetSkirtRing(int32 GridX, int32 GridY, TArray<int32>& OutRing)
+{
+	OutRing.Reset();
+	for (int32 X = 0; X < GridX; X++)
+	{
+		OutRing.Add(X);
+	}
+	for (int32 Y = 1; Y < GridY; Y++)
+	{
+		OutRing.Add(Y * GridX + GridX - 1);
+	}
+	for (int32 X = GridX - 2; X >= 0; X--)
+	{
+		OutRing.Add((GridY - 1) * GridX + X);
+	}
+	for (int32 Y = GridY - 2; Y > 0; Y--)
+	{
+		OutRing.Add(Y * GridX);
+	}
+}
+
+void AProcedurallyGeneratedMap::BuildChunkIndexBuffer(int32 NumX, int32 NumY, int32 LOD, TArray<int32>& OutTriangles)
+{
+	TArray<int32> CoordinatesX;
+	TArray<int32> CoordinatesY;
+	GetLODCoordinates(NumX, LOD, CoordinatesX);
+	GetLODCoordinates(NumY, LOD, CoordinatesY);
+	const int32 GridX = CoordinatesX.Num();
+	const int32 GridY = CoordinatesY.Num();
+
+	TArray<int32> Ring;
+	GetSkirtRing(GridX, GridY, Ring);
+
+	OutTriangles.Reset((GridX - 1) * (GridY - 1) * 6 + Ring.Num() * 12);
+	for (int32 Y = 0; Y < GridY - 1; Y++)
+	{
+		for (int32 X = 0; X < GridX - 1; X++)
+		{
+			const int32 Index = Y * GridX + X;
+			OutTriangles.Add(Index);
+			OutTriangles.Add(Index + GridX);
+			OutTriangles.Add(Index + 1);
+			OutTriangles.Add(Index + 1);
+			OutTriangles.Add(Index + GridX);
+			OutTriangles.Add(Index + GridX + 1);
+		}
+	}
+
+	// The skirt vertices come after the grid, one below each vertex of the ring. The skirt is drawn from
+	// both sides as the crack it covers can be seen from either of the neighbouring chunks.
+	const int32 FirstSkirtVertex = GridX * GridY;
+	for (int32 i = 0; i < Ring.Num(); i++)
+	{
+		const int32 Next = (i + 1) % Ring.Num();
+		const int32 Top = Ring[i];
+		const int32 NextTop = Ring[Next];
+		const int32 Bottom = FirstSkirtVertex + i;
+		const int32 NextBottom = FirstSkirtVertex + Next;
+
+		OutTriangles.Append({ Top, NextTop, Bottom, Bottom, NextTop, NextBottom });
+		OutTriangles.Append({ Top, Bottom, NextTop, NextTop, Bottom, NextBottom });
+	}
+}
+
+void AProcedurallyGeneratedMap::BuildChunkMeshData(int32 ChunkIndex, int32 LOD, FTerrainChunkMeshData& OutMeshData) const
+{
+	const FTerrainChunk& Chunk = Chunks[ChunkIndex];
+
+	TArray<int32> CoordinatesX;
+	TArray<int32> CoordinatesY;
+	GetLODCoordinates(Chunk.NumX, LOD, CoordinatesX);
+	GetLODCoordinates(Chunk.NumY, LOD, CoordinatesY);
+	const int32 GridX = CoordinatesX.Num();
+	const int32 GridY = CoordinatesY.Num();
+
+	TArray<int32> Ring;
+	GetSkirtRing(GridX, GridY, Ring);
+
+	const int32 NumVertices = GridX * GridY + Ring.Num();
+	OutMeshData.Vertices.SetNumUninitialized(NumVertices);
+	OutMeshData.UVCoords.SetNumUninitialized(NumVertices);
+	OutMeshData.Normals.SetNumUninitialized(NumVertices);
+	OutMeshData.Tangents.SetNumUninitialized(NumVertices);
+
+	for (int32 LocalY = 0; LocalY < GridY; LocalY++)
+	{
+		for (int32 LocalX = 0; LocalX < GridX; LocalX++)
+		{
+			const int32 X = Chunk.FirstX + CoordinatesX[LocalX];
+			const int32 Y = Chunk.FirstY + CoordinatesY[LocalY];
+			const int32 LocalIndex = LocalY * GridX + LocalX;
+
+			OutMeshData.Vertices[LocalIndex] = Vertices[Y * Width + X];
+			// UVs stay in grid coordinates so the texture lines up across chunk edges
+			OutMeshData.UVCoords[LocalIndex] = FVector2D(X, Y);
+			// The normals are taken from the whole heightfield so the lighting matches across chunk edges
+			const FVector& Normal = Normals[Y * Width + X];
+			OutMeshData.Normals[LocalIndex] = Normal;
+			// The U coordinate runs along X so the tangent follows the surface in that direction
+			OutMeshData.Tangents[LocalIndex] = FProcMeshTangent(FVector(Normal.Z, 0.0f, -Normal.X).GetSafeNormal(), false);
+		}
+	}
+
+	for (int32 i = 0; i < Ring.Num(); i++)
+	{
+		const int32 SkirtIndex = GridX * GridY + i;
+		OutMeshData.Vertices[SkirtIndex] = OutMeshData.Vertices[Ring[i]] - FVector(0.0f, 0.0f, SkirtDepth);
+		OutMeshData.UVCoords[SkirtIndex] = OutMeshData.UVCoords[Ring[i]];
+		OutMeshData.Normals[SkirtIndex] = OutMeshData.Normals[Ring[i]];
+		OutMeshData.Tangents[SkirtIndex] = OutMeshData.Tangents[Ring[i]];
+	}
+}
+
+void AProcedurallyGeneratedMap::LoadChunk(int32 ChunkIndex, int32 LOD, bool bCollision, const FTerrainChunkMeshData& MeshData)
+{
+	FTerrainChunk& Chunk = Chunks[ChunkIndex];
+	const TArray<int32>& Triangles = ChunkIndexBuffers.FindChecked(FIntVector(Chunk.NumX, Chunk.NumY, LOD));
+
+	// The mesh component keeps its own copy of the section so the chunk data can be thrown away afterwards
+	MeshComponent->CreateMeshSection(ChunkIndex, MeshData.Vertices, Triangles, MeshData.Normals, MeshData.UVCoords, TArray<FColor>(), MeshData.Tangents, bCollision);
+	if (Chunk.LOD == INDEX_NONE)
+	{
+		NumLoadedChunks++;
+	}
+	Chunk.LOD = LOD;
+	Chunk.bCollision = bCollision;
+}
+
+void AProcedurallyGeneratedMap::UnloadChunk(int32 ChunkIndex)
+{
+	MeshComponent->ClearMeshSection(ChunkIndex);
+	if (Chunks[ChunkIndex].LOD != INDEX_NONE)
+	{
+		Chunks[ChunkIndex].LOD = INDEX_NONE;
+		Chunks[ChunkIndex].bCollision = false;
+		NumLoadedChunks--;
+	}
+}
+
+float AProcedurallyGeneratedMap::GetDistanceToChunk(int32 ChunkIndex, const FVector& Location) const
+{
+	const FTerrainChunk& Chunk = Chunks[ChunkIndex];
+	const FBox2D Bounds(
+		FVector2D(Chunk.FirstX * GridSize, Chunk.FirstY * GridSize),
+		FVector2D((Chunk.FirstX + Chunk.NumX - 1) * GridSize, (Chunk.FirstY + Chunk.NumY - 1) * GridSize));
+	return FMath::Sqrt(Bounds.ComputeSquaredDistanceToPoint(FVector2D(Location)));
+}
+
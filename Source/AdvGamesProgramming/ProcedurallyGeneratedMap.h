@@ -5,8 +5,68 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "ProceduralMeshComponent.h"
+#include "TerrainNoise.h"
+#include "TerrainSnapshot.h"
+#include "TerrainLineOfSight.h"
 #include "ProcedurallyGeneratedMap.generated.h"
 
+/**
+Everything needed to generate the same terrain again. The server replicates this instead of the geometry and
+every client generates the map from it, using the checksum to make sure it ended up with the same heights.
+*/
+USTRUCT()
+struct FTerrainGenerationDescriptor
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	int32 Seed = 0;
+	UPROPERTY()
+	int32 Width = 0;
+	UPROPERTY()
+	int32 Height = 0;
+	UPROPERTY()
+	float GridSize = 0.0f;
+	UPROPERTY()
+	TerrainNoiseType NoiseType = TerrainNoiseType::FBM;
+	UPROPERTY()
+	int32 Octaves = 1;
+	UPROPERTY()
+	float Frequency = 0.0f;
+	UPROPERTY()
+	float Amplitude = 0.0f;
+	UPROPERTY()
+	float Lacunarity = 0.0f;
+	UPROPERTY()
+	float Persistence = 0.0f;
+	UPROPERTY()
+	float DomainWarpStrength = 0.0f;
+	// CRC of the generated heights.
+	UPROPERTY()
+	uint32 Checksum = 0;
+};
+
+/**
+One edit made to the terrain after it was generated. The server replicates every edit in order so clients, including
+ones that join later, can apply them to their own copy of the generated map.
+*/
+USTRUCT()
+struct FTerrainDeformation
+{
+	GENERATED_BODY()
+
+	// The centre of the deformation in the map's local space.
+	UPROPERTY()
+	FVector2D Location = FVector2D::ZeroVector;
+	UPROPERTY()
+	float Radius = 0.0f;
+	UPROPERTY()
+	float Depth = 0.0f;
+	// CRC of the heights inside the changed region once the edit has been applied.
+	UPROPERTY()
+	uint32 Checksum = 0;
+};
+
 UCLASS()
 class ADVGAMESPROGRAMMING_API AProcedurallyGeneratedMap : public AActor
 {
@@ -36,17 +96,103 @@ public:
 	float PerlinScale;
 	UPROPERTY(EditAnywhere)
 	float PerlinRoughness;
+	UPROPERTY(EditAnywhere)
+	TerrainNoiseType NoiseType;
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "1"))
+	int32 PerlinOctaves;
+	UPROPERTY(EditAnywhere)
+	float PerlinLacunarity;
+	UPROPERTY(EditAnywhere)
+	float PerlinPersistence;
+	UPROPERTY(EditAnywhere)
+	float DomainWarpStrength;
+
+	// The same seed always generates the same terrain.
+	UPROPERTY(EditAnywhere)
+	int32 Seed;
+	// Picks a new seed every time the map is generated. Off by default so the level keeps its designed terrain,
+	// and terrain generated from a random seed is never written to the terrain cache as it would not be asked for again.
+	UPROPERTY(EditAnywhere)
+	bool bRandomizeSeed;
+	// Generates the terrain again at the start of every match instead of keeping the terrain saved with the level.
+	UPROPERTY(EditAnywhere)
+	bool bGenerateOnMatchStart;
 
 	UPROPERTY(EditAnywhere)
 	bool bRegenerateMap;
 
+	// The number of grid cells along each side of a terrain chunk. Each chunk is its own mesh section.
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "1"))
+	int32 ChunkSize;
+	// Whether chunks are only built near players while playing instead of all at once.
+	UPROPERTY(EditAnywhere)
+	bool bStreamChunks;
+	// Chunks closer than this to a player are loaded.
+	UPROPERTY(EditAnywhere, meta = (EditCondition = "bStreamChunks"))
+	float ChunkStreamingDistance;
+	// The most chunks that will be built or rebuilt in a single frame while playing.
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "1"))
+	int32 MaxChunkLoadsPerFrame;
+
+	// The number of detail levels per chunk, each one skips twice as many grid cells as the one before.
+	UPROPERTY(EditAnywhere, meta = (ClampMin = "1", ClampMax = "8"))
+	int32 NumLODs;
+	// How far from a player each lower detail level starts.
+	UPROPERTY(EditAnywhere)
+	float LODDistance;
+	// Chunks closer than this to any pawn are kept at full detail with collision, all other chunks have no collision.
+	UPROPERTY(EditAnywhere)
+	float ChunkCollisionDistance;
+	// How far the skirts around each chunk hang down to hide the cracks between chunks at different detail levels.
+	UPROPERTY(EditAnywhere)
+	float SkirtDepth;
+
+	// The heightfield, kept for the whole map as the navigation graph and pickups are built from it.
 	UPROPERTY(VisibleAnywhere)
 	TArray<FVector> Vertices;
 
-	TArray<int32> Triangles;
-	TArray<FVector2D> UVCoords;
-	TArray<FVector> Normals;
-	TArray<FProcMeshTangent> Tangents;
+	/**
+	Gets the latest read-only snapshot of the heightfield, sharing it instead of copying the vertices.
+	@return The snapshot, or null if the map has not been generated.
+	*/
+	FTerrainSnapshotPtr GetTerrainSnapshot();
+
+	/**
+	Fast ground queries straight from the heightfield, without any physics traces. Locations are in world space and
+	only their X and Y are used. Locations off the map use the height at the nearest edge.
+	*/
+	UFUNCTION(BlueprintCallable)
+	float GetHeightAt(const FVector& Location) const;
+	UFUNCTION(BlueprintCallable)
+	FVector GetNormalAt(const FVector& Location) const;
+	// The steepness of the terrain in degrees, 0 is flat.
+	UFUNCTION(BlueprintCallable)
+	float GetSlopeAt(const FVector& Location) const;
+
+	// Batched versions of the ground queries, the output arrays are filled with one value per location.
+	void GetHeightsAt(const TArray<FVector>& Locations, TArray<float>& OutHeights) const;
+	void GetNormalsAt(const TArray<FVector>& Locations, TArray<FVector>& OutNormals) const;
+	void GetSlopesAt(const TArray<FVector>& Locations, TArray<float>& OutSlopes) const;
+
+	/**
+	Tests whether the terrain blocks the segment between two world space locations, without any physics traces.
+	@return Whether the segment stays above the terrain, always true before the terrain is generated.
+	*/
+	UFUNCTION(BlueprintCallable)
+	bool HasLineOfSight(const FVector& Start, const FVector& End) const;
+	/**
+	Tests a batch of world space segments against the terrain.
+	@param OutVisible - Filled with the result of each query, in the same order.
+	@param bUseWorkerThreads - Whether to spread the queries over the worker threads.
+	*/
+	void HasLineOfSightBatch(const TArray<FLineOfSightQuery>& Queries, TArray<bool>& OutVisible, bool bUseWorkerThreads) const;
+
+	// Broadcast with the new snapshot whenever the heightfield is generated or changed.
+	FTerrainSnapshotPublished OnTerrainSnapshotPublished;
+
+	// Whether generated heights, normals and navigation graphs are saved to and loaded from the terrain cache.
+	UPROPERTY(EditAnywhere)
+	bool bUseTerrainCache;
 
 	UPROPERTY(EditAnywhere)
 	class AAIManager* AIManager;
@@ -59,6 +205,175 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void GenerateMap();
 
+	/**
+	Gets the map ready for a match on the server. The terrain saved with the level is kept and only its descriptor is replicated,
+	unless the level has no terrain or bGenerateOnMatchStart is set.
+	*/
+	void PrepareForMatch();
+
+	// The parameters and checksum of the last generated map, replicated so clients can generate it for themselves.
+	UPROPERTY(ReplicatedUsing = OnRep_GenerationDescriptor)
+	FTerrainGenerationDescriptor GenerationDescriptor;
+
+	void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	// Works out the checksum of the current heights.
+	uint32 CalculateChecksum() const;
+
 	void ClearMap();
 
+	/**
+	Pushes changed heights out to the mesh and the AI navigation graph without rebuilding the rest of the map.
+	Call after changing the Z of the vertices inside the region.
+	@param MinX, MinY, MaxX, MaxY - The inclusive grid coordinates of the changed vertices.
+	*/
+	void UpdateRegion(int32 MinX, int32 MinY, int32 MaxX, int32 MaxY);
+
+	/**
+	Raises or lowers the terrain around a point, falling off smoothly towards the edge of the radius.
+	Only the server can deform the terrain, the edit is replicated to the clients.
+	@param Location - The world location at the centre of the deformation.
+	@param Radius - How far the deformation reaches across the terrain.
+	@param Depth - How far the terrain at the centre is pushed down, negative values raise it.
+	*/
+	UFUNCTION(BlueprintCallable)
+	void DeformTerrain(const FVector& Location, float Radius, float Depth);
+
+	/**
+	Checks whether the cooked terrain collision below or above a location is ready to use.
+	@param Location - The world location to check.
+	@return Whether the terrain under the location can be collided with.
+	*/
+	bool HasCollisionAt(const FVector& Location);
+
+	/**
+	Keeps collision built around a location even when no pawn is near it, so something can be spawned there.
+	@param Location - The world location that needs collision.
+	@param Duration - How many seconds the collision is kept for.
+	*/
+	void RequestCollisionAt(const FVector& Location, float Duration);
+
+	int32 GetNumChunks() const { return Chunks.Num(); }
+	int32 GetNumLoadedChunks() const { return NumLoadedChunks; }
+
+private:
+
+	UFUNCTION()
+	void OnRep_GenerationDescriptor();
+
+	// Every edit made to the terrain since it was generated, in the order they were made.
+	UPROPERTY(ReplicatedUsing = OnRep_Deformations)
+	TArray<FTerrainDeformation> Deformations;
+	// The number of Deformations that have been applied to the heights on this machine.
+	int32 NumAppliedDeformations;
+
+	UFUNCTION()
+	void OnRep_Deformations();
+
+	// Applies the replicated edits this machine has not applied yet, once it has the generated terrain to apply them to.
+	void ApplyPendingDeformations();
+
+	/**
+	Changes the heights for one edit and pushes them out to the mesh and navigation.
+	@param OutChecksum - Filled with the CRC of the heights inside the changed region.
+	@return Whether the edit touched the grid.
+	*/
+	bool ApplyDeformation(const FTerrainDeformation& Deformation, uint32& OutChecksum);
+
+	// Describes the terrain the current settings and seed generate, without the checksum.
+	FTerrainGenerationDescriptor MakeDescriptor() const;
+
+	// Generates the heightfield, mesh and navigation graph from the descriptor without picking a new seed.
+	void GenerateFromDescriptor(const FTerrainGenerationDescriptor& Descriptor);
+
+	struct FTerrainChunk
+	{
+		// The grid coordinates of the first vertex in the chunk.
+		int32 FirstX;
+		int32 FirstY;
+		// The number of vertices along each side, neighbouring chunks share the vertices along their edges.
+		int32 NumX;
+		int32 NumY;
+		// The detail level the chunk's mesh section was built at, or INDEX_NONE when it is not loaded.
+		int32 LOD;
+		bool bCollision;
+	};
+
+	// Render data for one chunk, only kept until it has been handed to the mesh component.
+	struct FTerrainChunkMeshData
+	{
+		TArray<FVector> Vertices;
+		TArray<FVector2D> UVCoords;
+		TArray<FVector> Normals;
+		TArray<FProcMeshTangent> Tangents;
+	};
+
+	TArray<FTerrainChunk> Chunks;
+
+	// A location that needs collision without a pawn standing there.
+	struct FCollisionRequest
+	{
+		FVector LocalLocation;
+		float ExpiryTime;
+	};
+	TArray<FCollisionRequest> CollisionRequests;
+	// Chunks with the same size share their index buffers, keyed by (NumX, NumY, LOD).
+	TMap<FIntVector, TArray<int32>> ChunkIndexBuffers;
+	int32 NumChunksX;
+	int32 NumChunksY;
+	int32 NumLoadedChunks;
+	// The chunk size the current chunks were laid out with.
+	int32 ChunkLayoutSize;
+
+	// Whether the map can be regenerated by only changing heights, keeping the chunks and their index buffers.
+	bool CanUpdateInPlace() const;
+	// Rebuilds the vertex data of every loaded chunk overlapping the region and updates their sections in place.
+	void RefreshChunks(int32 MinX, int32 MinY, int32 MaxX, int32 MaxY);
+
+	// Splits the current heightfield into chunks without building any of them.
+	void InitialiseChunks();
+	// Builds every chunk at once, used in the editor and when streaming is turned off.
+	void LoadAllChunks();
+	// Loads the chunks near the players, drops the ones that have moved out of range and switches detail levels and collision.
+	void UpdateChunks();
+	void BuildChunkMeshData(int32 ChunkIndex, int32 LOD, FTerrainChunkMeshData& OutMeshData) const;
+	void LoadChunk(int32 ChunkIndex, int32 LOD, bool bCollision, const FTerrainChunkMeshData& MeshData);
+	void UnloadChunk(int32 ChunkIndex);
+
+	int32 GetLODForDistance(float Distance) const;
+
+	/**
+	Works out which vertices along one side of a chunk are kept at a detail level.
+	@param NumVertices - The number of vertices along the side at full detail.
+	@param LOD - The detail level.
+	@param OutCoordinates - Filled with the local coordinate of every kept vertex, the first and last are always kept.
+	*/
+	static void GetLODCoordinates(int32 NumVertices, int32 LOD, TArray<int32>& OutCoordinates);
+	// Builds the index buffer for a chunk of the given size, the surface grid is followed by a skirt around the edge.
+	static void BuildChunkIndexBuffer(int32 NumX, int32 NumY, int32 LOD, TArray<int32>& OutTriangles);
+	// The grid positions of the vertices around the edge of a LOD grid that the skirt hangs from, in order.
+	static void GetSkirtRing(int32 GridX, int32 GridY, TArray<int32>& OutRing);
+	// The distance on the XY plane between a location and the closest point of a chunk.
+	float GetDistanceToChunk(int32 ChunkIndex, const FVector& Location) const;
+
+	FTerrainSnapshotPtr TerrainSnapshot;
+	uint32 TerrainGeneration;
+
+	// Makes a snapshot of the current heightfield and tells everything listening about it.
+	void PublishTerrainSnapshot();
+	// Publishes a snapshot after only the vertices inside the region changed, sharing the untouched parts with the last one.
+	void PublishTerrainSnapshot(int32 MinX, int32 MinY, int32 MaxX, int32 MaxY);
+
+	// The normal of every vertex in the heightfield, worked out once and shared by every chunk and detail level.
+	TArray<FVector> Normals;
+
+	// Works out the vertex normal from the slope of the heightfield around the vertex.
+	FVector CalculateNormal(int32 X, int32 Y) const;
+	// Recalculates the normals of the vertices inside the region.
+	void UpdateNormals(int32 MinX, int32 MinY, int32 MaxX, int32 MaxY);
+	// Tries to fill the heightfield, normals and navigation graph from the terrain cache.
+	bool LoadFromCache(const FTerrainGenerationDescriptor& Descriptor);
+	void SaveToCache(const FTerrainGenerationDescriptor& Descriptor) const;
+	struct FTerrainCacheKey MakeCacheKey(const FTerrainGenerationDescriptor& Descriptor) const;
+
 };
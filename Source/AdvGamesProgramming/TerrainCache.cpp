@@ -0,0 +1,228 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainCache.h"
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/FileManager.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+	const uint32 CACHE_MAGIC = 0x43524554; // "TERC"
+	// Every array starts on this boundary so the mapped data is suitably aligned for its type.
+	const int64 SECTION_ALIGNMENT = 16;
+	// Only the most recently written files are kept so the cache directory cannot grow without bound.
+	const int32 MAX_CACHE_FILES = 8;
+
+	struct FCacheHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		FTerrainCacheKey Key;
+		int32 NumVertices;
+		int32 NumNavigationNodes;
+		int32 NumEdges;
+		// Byte offsets from the start of the file.
+		int64 VerticesOffset;
+		int64 NormalsOffset;
+		int64 EdgeOffsetsOffset;
+		int64 EdgeTargetsOffset;
+		int64 EdgeCostsOffset;
+		int64 FileSize;
+	};
+
+	int64 AlignOffset(int64 Offset)
+	{
+		return Align(Offset, SECTION_ALIGNMENT);
+	}
+
+	// Copies Num elements stored at Offset into the array, returning false if they would run past the end of the file.
+	template <typename ElementType>
+	bool CopySection(const uint8* Data, int64 FileSize, int64 Offset, int32 Num, TArray<ElementType>& OutArray)
+	{
+		if (Num < 0 || Offset < 0 || Offset + int64(Num) * sizeof(ElementType) > FileSize)
+		{
+			return false;
+		}
+		OutArray.SetNumUninitialized(Num);
+		FMemory::Memcpy(OutArray.GetData(), Data + Offset, int64(Num) * sizeof(ElementType));
+		return true;
+	}
+
+	FString GetCacheDirectory()
+	{
+		return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("TerrainCache"));
+	}
+
+	// Deletes the oldest cache files until no more than MAX_CACHE_FILES are left.
+	void PruneCacheDirectory()
+	{
+		IFileManager& FileManager = IFileManager::Get();
+		const FString Directory = GetCacheDirectory();
+		TArray<FString> FileNames;
+		FileManager.FindFiles(FileNames, *FPaths::Combine(Directory, TEXT("Terrain_*.bin")), true, false);
+		if (FileNames.Num() <= MAX_CACHE_FILES)
+		{
+			return;
+		}
+
+		TArray<TPair<FDateTime, FString>> Files;
+		for (const FString& FileName : FileNames)
+		{
+			const FString Path = FPaths::Combine(Directory, FileName);
+			Files.Emplace(FileManager.GetTimeStamp(*Path), Path);
+		}
+		Files.Sort([](const TPair<FDateTime, FString>& A, const TPair<FDateTime, FString>& B) { return A.Key < B.Key; });
+
+		for (int32 i = 0; i < Files.Num() - MAX_CACHE_FILES; i++)
+		{
+			FileManager.Delete(*Files[i].Value);
+		}
+	}
+
+	// Checks that the edge arrays of a loaded graph describe a valid compressed sparse row layout, so the searches
+	// cannot read outside them even if the file was damaged or edited
+	bool IsValidGraphLayout(const FNavigationGraph& Graph, int32 NumNodes, int32 NumEdges)
+	{
+		if (Graph.EdgeOffsets.Num() != NumNodes + 1 || Graph.EdgeOffsets[0] != 0 || Graph.EdgeOffsets[NumNodes] != NumEdges)
+		{
+			return false;
+		}
+		for (int32 Node = 0; Node < NumNodes; Node++)
+		{
+			if (Graph.EdgeOffsets[Node] > Graph.EdgeOffsets[Node + 1])
+			{
+				return false;
+			}
+		}
+		for (int32 Target : Graph.EdgeTargets)
+		{
+			if (Target < 0 || Target >= NumNodes)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template <typename ElementType>
+	void WriteSection(TArray<uint8>& Buffer, int64 Offset, const TArray<ElementType>& Array)
+	{
+		FMemory::Memcpy(Buffer.GetData() + Offset, Array.GetData(), int64(Array.Num()) * sizeof(ElementType));
+	}
+}
+
+FString FTerrainCache::GetCachePath(const FTerrainCacheKey& Key)
+{
+	return FPaths::Combine(GetCacheDirectory(), FString::Printf(TEXT("Terrain_%08x.bin"), Key.GetHash()));
+}
+
+bool FTerrainCache::Load(const FTerrainCacheKey& Key, FTerrainCacheData& OutData)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	const FString Path = GetCachePath(Key);
+	if (!PlatformFile.FileExists(*Path))
+	{
+		return false;
+	}
+
+	// The region is declared after the handle so it is unmapped before the file is closed
+	TUniquePtr<IMappedFileHandle> MappedFile(PlatformFile.OpenMapped(*Path));
+	if (!MappedFile || MappedFile->GetFileSize() < int64(sizeof(FCacheHeader)))
+	{
+		return false;
+	}
+	TUniquePtr<IMappedFileRegion> MappedRegion(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+	if (!MappedRegion)
+	{
+		return false;
+	}
+
+	const uint8* Data = MappedRegion->GetMappedPtr();
+	const int64 FileSize = MappedRegion->GetMappedSize();
+	FCacheHeader Header;
+	FMemory::Memcpy(&Header, Data, sizeof(FCacheHeader));
+
+	if (Header.Magic != CACHE_MAGIC || Header.Version != VERSION || Header.FileSize != FileSize
+		|| FMemory::Memcmp(&Header.Key, &Key, sizeof(FTerrainCacheKey)) != 0
+		|| Header.NumVertices != Key.Width * Key.Height)
+	{
+		UE_LOG(LogTemp, Display, TEXT("Terrain cache %s is stale"), *Path)
+		return false;
+	}
+
+	bool bValid = CopySection(Data, FileSize, Header.VerticesOffset, Header.NumVertices, OutData.Vertices)
+		&& CopySection(Data, FileSize, Header.NormalsOffset, Header.NumVertices, OutData.Normals);
+
+	OutData.NavigationGraph.Empty();
+	if (bValid && Header.NumNavigationNodes > 0)
+	{
+		// The graph nodes are the vertices so their positions are not stored twice
+		OutData.NavigationGraph.Positions = OutData.Vertices;
+		bValid = Header.NumNavigationNodes == Header.NumVertices
+			&& CopySection(Data, FileSize, Header.EdgeOffsetsOffset, Header.NumNavigationNodes + 1, OutData.NavigationGraph.EdgeOffsets)
+			&& CopySection(Data, FileSize, Header.EdgeTargetsOffset, Header.NumEdges, OutData.NavigationGraph.EdgeTargets)
+			&& CopySection(Data, FileSize, Header.EdgeCostsOffset, Header.NumEdges, OutData.NavigationGraph.EdgeCosts)
+			&& IsValidGraphLayout(OutData.NavigationGraph, Header.NumNavigationNodes, Header.NumEdges);
+	}
+
+	if (!bValid)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Terrain cache %s is corrupt"), *Path)
+		OutData.NavigationGraph.Empty();
+	}
+	return bValid;
+}
+
+bool FTerrainCache::Save(const FTerrainCacheKey& Key, const FTerrainCacheData& Data)
+{
+	const FNavigationGraph& Graph = Data.NavigationGraph;
+	check(Data.Normals.Num() == Data.Vertices.Num());
+	check(Graph.Num() == 0 || Graph.Num() == Data.Vertices.Num());
+
+	FCacheHeader Header;
+	FMemory::Memzero(Header);
+	Header.Magic = CACHE_MAGIC;
+	Header.Version = VERSION;
+	Header.Key = Key;
+	Header.NumVertices = Data.Vertices.Num();
+	Header.NumNavigationNodes = Graph.Num();
+	Header.NumEdges = Graph.Num() > 0 ? Graph.EdgeTargets.Num() : 0;
+
+	// Lay the sections out one after another, each starting on an aligned offset
+	int64 Offset = AlignOffset(sizeof(FCacheHeader));
+	Header.VerticesOffset = Offset;
+	Offset = AlignOffset(Offset + int64(Data.Vertices.Num()) * sizeof(FVector));
+	Header.NormalsOffset = Offset;
+	Offset = AlignOffset(Offset + int64(Data.Normals.Num()) * sizeof(FVector));
+	Header.EdgeOffsetsOffset = Offset;
+	Offset = AlignOffset(Offset + int64(Header.NumNavigationNodes > 0 ? Graph.EdgeOffsets.Num() : 0) * sizeof(int32));
+	Header.EdgeTargetsOffset = Offset;
+	Offset = AlignOffset(Offset + int64(Header.NumEdges) * sizeof(int32));
+	Header.EdgeCostsOffset = Offset;
+	Offset += int64(Header.NumEdges) * sizeof(float);
+	Header.FileSize = Offset;
+
+	TArray<uint8> Buffer;
+	Buffer.SetNumZeroed(Header.FileSize);
+	FMemory::Memcpy(Buffer.GetData(), &Header, sizeof(FCacheHeader));
+	WriteSection(Buffer, Header.VerticesOffset, Data.Vertices);
+	WriteSection(Buffer, Header.NormalsOffset, Data.Normals);
+	if (Header.NumNavigationNodes > 0)
+	{
+		WriteSection(Buffer, Header.EdgeOffsetsOffset, Graph.EdgeOffsets);
+		WriteSection(Buffer, Header.EdgeTargetsOffset, Graph.EdgeTargets);
+		WriteSection(Buffer, Header.EdgeCostsOffset, Graph.EdgeCosts);
+	}
+
+	const FString Path = GetCachePath(Key);
+	if (!FFileHelper::SaveArrayToFile(Buffer, *Path))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Unable to write terrain cache %s"), *Path)
+		return false;
+	}
+	PruneCacheDirectory();
+	return true;
+}
@@ -0,0 +1,68 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NavigationGraph.h"
+
+/**
+Everything the cached data depends on. Two keys with the same bytes always describe the same terrain and graph.
+*/
+struct FTerrainCacheKey
+{
+	int32 Seed = 0;
+	int32 Width = 0;
+	int32 Height = 0;
+	float GridSize = 0.0f;
+	int32 NoiseType = 0;
+	int32 Octaves = 0;
+	float Frequency = 0.0f;
+	float Amplitude = 0.0f;
+	float Lacunarity = 0.0f;
+	float Persistence = 0.0f;
+	float DomainWarpStrength = 0.0f;
+	// The slope limit the navigation graph was built with, negative when the cache has no graph.
+	float NavigationAllowedAngle = -1.0f;
+
+	uint32 GetHash() const { return FCrc::MemCrc32(this, sizeof(FTerrainCacheKey)); }
+};
+
+/**
+The data stored in a terrain cache file.
+*/
+struct FTerrainCacheData
+{
+	TArray<FVector> Vertices;
+	TArray<FVector> Normals;
+	// Empty when the terrain was generated without an AI manager.
+	FNavigationGraph NavigationGraph;
+};
+
+/**
+Versioned binary cache of a generated heightfield and its navigation graph.
+Every array is stored with the same layout it has in memory, so loading the memory-mapped file is a bulk copy
+of each array with no parsing. Files with a different version or key are treated as missing.
+*/
+struct ADVGAMESPROGRAMMING_API FTerrainCache
+{
+	// Bump whenever the file layout or the way the cached data is generated changes.
+	static const uint32 VERSION = 1;
+
+	// The file in the project's Saved directory the terrain with this key is cached in.
+	static FString GetCachePath(const FTerrainCacheKey& Key);
+
+	/**
+	Reads a cache file.
+	@param Key - The key the file has to have been written with.
+	@param OutData - Filled with the cached data.
+	@return Whether the file exists, is not stale and was read completely.
+	*/
+	static bool Load(const FTerrainCacheKey& Key, FTerrainCacheData& OutData);
+
+	/**
+	Writes a cache file, replacing any existing file for the same key. The oldest files are deleted once the
+	directory holds more than a handful of them.
+	@return Whether the file was written.
+	*/
+	static bool Save(const FTerrainCacheKey& Key, const FTerrainCacheData& Data);
+};
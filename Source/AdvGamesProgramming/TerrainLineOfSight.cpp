@@ -0,0 +1,158 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainLineOfSight.h"
+#include "Async/ParallelFor.h"
+
+namespace
+{
+	/**
+	Clips the parameter range of a segment along one axis to the grid.
+	@param Start - The start of the segment on this axis in grid units.
+	@param Delta - The change along the segment on this axis in grid units.
+	@param Max - The largest grid coordinate on this axis.
+	@return Whether any of the segment is left inside the grid.
+	*/
+	bool ClipToGrid(float Start, float Delta, float Max, float& InOutTMin, float& InOutTMax)
+	{
+		if (Delta == 0.0f)
+		{
+			return Start >= 0.0f && Start <= Max;
+		}
+		float T0 = -Start / Delta;
+		float T1 = (Max - Start) / Delta;
+		if (T0 > T1)
+		{
+			Swap(T0, T1);
+		}
+		InOutTMin = FMath::Max(InOutTMin, T0);
+		InOutTMax = FMath::Min(InOutTMax, T1);
+		return InOutTMin <= InOutTMax;
+	}
+
+	// The parameter at which the walk leaves the current cell along one axis.
+	float GetFirstCrossing(float Start, float Delta, int32 Cell)
+	{
+		if (Delta > 0.0f)
+		{
+			return (Cell + 1 - Start) / Delta;
+		}
+		if (Delta < 0.0f)
+		{
+			return (Cell - Start) / Delta;
+		}
+		return MAX_FLT;
+	}
+}
+
+bool FTerrainLineOfSight::HasLineOfSight(const FTerrainSnapshot& Terrain, const FVector& Start, const FVector& End)
+{
+	const int32 Width = Terrain.GetGridWidth();
+	const int32 Height = Terrain.GetGridHeight();
+	if (Width < 2 || Height < 2)
+	{
+		return true;
+	}
+
+	// Work in grid units so every cell is one unit across
+	const float GridSize = Terrain.GetGridSize();
+	const FVector GridStart(Start.X / GridSize, Start.Y / GridSize, Start.Z);
+	const FVector Delta((End.X - Start.X) / GridSize, (End.Y - Start.Y) / GridSize, End.Z - Start.Z);
+
+	float TMin = 0.0f;
+	float TMax = 1.0f;
+	if (!ClipToGrid(GridStart.X, Delta.X, Width - 1, TMin, TMax) || !ClipToGrid(GridStart.Y, Delta.Y, Height - 1, TMin, TMax))
+	{
+		return true;
+	}
+
+	int32 CellX = FMath::Clamp(FMath::FloorToInt(GridStart.X + TMin * Delta.X), 0, Width - 2);
+	int32 CellY = FMath::Clamp(FMath::FloorToInt(GridStart.Y + TMin * Delta.Y), 0, Height - 2);
+	const int32 StepX = Delta.X > 0.0f ? 1 : -1;
+	const int32 StepY = Delta.Y > 0.0f ? 1 : -1;
+	const float TDeltaX = Delta.X != 0.0f ? 1.0f / FMath::Abs(Delta.X) : MAX_FLT;
+	const float TDeltaY = Delta.Y != 0.0f ? 1.0f / FMath::Abs(Delta.Y) : MAX_FLT;
+	float TNextX = GetFirstCrossing(GridStart.X, Delta.X, CellX);
+	float TNextY = GetFirstCrossing(GridStart.Y, Delta.Y, CellY);
+	float T = TMin;
+
+	while (true)
+	{
+		const float TExit = FMath::Min3(TNextX, TNextY, TMax);
+
+		const float H00 = Terrain.GetHeight(CellX, CellY);
+		const float H10 = Terrain.GetHeight(CellX + 1, CellY);
+		const float H01 = Terrain.GetHeight(CellX, CellY + 1);
+		const float H11 = Terrain.GetHeight(CellX + 1, CellY + 1);
+		const float RayEnter = GridStart.Z + T * Delta.Z;
+		const float RayExit = GridStart.Z + TExit * Delta.Z;
+
+		// The bilinear surface never rises above its highest corner, so most cells are cleared without sampling
+		if (FMath::Min(RayEnter, RayExit) < FMath::Max(FMath::Max(H00, H10), FMath::Max(H01, H11)))
+		{
+			if (FMath::Max(RayEnter, RayExit) < FMath::Min(FMath::Min(H00, H10), FMath::Min(H01, H11)))
+			{
+				return false;
+			}
+
+			// Along the segment the bilinear surface is a quadratic in T and the segment is linear, so the surface rises
+			// furthest above the segment either where it enters or leaves the cell or at the peak of that quadratic
+			const float CornerTerm = H00 - H10 - H01 + H11;
+			const float OffsetX = GridStart.X - CellX;
+			const float OffsetY = GridStart.Y - CellY;
+			const float Quadratic = CornerTerm * Delta.X * Delta.Y;
+			const float Linear = (H10 - H00) * Delta.X + (H01 - H00) * Delta.Y + CornerTerm * (OffsetX * Delta.Y + OffsetY * Delta.X) - Delta.Z;
+			float SampleT[3] = { T, TExit, T };
+			int32 NumSamples = 2;
+			if (Quadratic < 0.0f)
+			{
+				const float PeakT = -Linear / (2.0f * Quadratic);
+				if (PeakT > T && PeakT < TExit)
+				{
+					SampleT[NumSamples++] = PeakT;
+				}
+			}
+			for (int32 Sample = 0; Sample < NumSamples; Sample++)
+			{
+				const float SampleAt = SampleT[Sample];
+				const float AlphaX = FMath::Clamp(OffsetX + SampleAt * Delta.X, 0.0f, 1.0f);
+				const float AlphaY = FMath::Clamp(OffsetY + SampleAt * Delta.Y, 0.0f, 1.0f);
+				const float Surface = FMath::Lerp(FMath::Lerp(H00, H10, AlphaX), FMath::Lerp(H01, H11, AlphaX), AlphaY);
+				if (GridStart.Z + SampleAt * Delta.Z < Surface)
+				{
+					return false;
+				}
+			}
+		}
+
+		if (TExit >= TMax)
+		{
+			return true;
+		}
+
+		if (TNextX < TNextY)
+		{
+			CellX += StepX;
+			TNextX += TDeltaX;
+		}
+		else
+		{
+			CellY += StepY;
+			TNextY += TDeltaY;
+		}
+		if (CellX < 0 || CellX > Width - 2 || CellY < 0 || CellY > Height - 2)
+		{
+			return true;
+		}
+		T = TExit;
+	}
+}
+
+void FTerrainLineOfSight::HasLineOfSightBatch(const FTerrainSnapshot& Terrain, const TArray<FLineOfSightQuery>& Queries, TArray<bool>& OutVisible, bool bUseWorkerThreads)
+{
+	OutVisible.SetNumUninitialized(Queries.Num());
+	ParallelFor(Queries.Num(), [&](int32 i)
+	{
+		OutVisible[i] = HasLineOfSight(Terrain, Queries[i].Start, Queries[i].End);
+	}, !bUseWorkerThreads);
+}
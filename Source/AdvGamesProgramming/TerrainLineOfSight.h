@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TerrainSnapshot.h"
+
+/**
+A segment to test for line of sight, from the eye of the looker to the point being looked at.
+*/
+struct FLineOfSightQuery
+{
+	FVector Start;
+	FVector End;
+
+	FLineOfSightQuery() {}
+	FLineOfSightQuery(const FVector& InStart, const FVector& InEnd) : Start(InStart), End(InEnd) {}
+};
+
+/**
+Line of sight tests against the heightfield of a terrain snapshot instead of the physics scene.
+The segment is walked across the grid cells it passes over with a DDA, so a test only reads the cells under it and
+most cells are accepted from their corner heights alone. The other cells are tested exactly against the bilinear
+surface by finding where it rises furthest above the segment, so no ridge can slip between samples. Snapshots are immutable so tests can run on any thread.
+All locations are in the map's local space and only the terrain is treated as an occluder.
+*/
+struct ADVGAMESPROGRAMMING_API FTerrainLineOfSight
+{
+	/**
+	Tests whether the terrain blocks a segment.
+	@param Terrain - The heightfield to test against.
+	@param Start - Where the segment starts.
+	@param End - Where the segment ends.
+	@return Whether the segment stays above the terrain the whole way. Parts of the segment off the map never block.
+	*/
+	static bool HasLineOfSight(const FTerrainSnapshot& Terrain, const FVector& Start, const FVector& End);
+
+	/**
+	Tests a batch of segments.
+	@param Queries - The segments to test.
+	@param OutVisible - Filled with the result of each query, in the same order.
+	@param bUseWorkerThreads - Whether to spread the queries over the worker threads rather than run them on this thread.
+	*/
+	static void HasLineOfSightBatch(const FTerrainSnapshot& Terrain, const TArray<FLineOfSightQuery>& Queries, TArray<bool>& OutVisible, bool bUseWorkerThreads);
+};
@@ -0,0 +1,230 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainNoise.h"
+#include "Math/RandomStream.h"
+
+// Only SSE2 is used so the kernel needs no extra compiler flags on any x86 target.
+#define TERRAIN_NOISE_SSE (PLATFORM_ENABLE_VECTORINTRINSICS && PLATFORM_CPU_X86_FAMILY)
+
+#if TERRAIN_NOISE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const float GRADIENTS_X[8] = { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 0.0f, 0.0f };
+	const float GRADIENTS_Y[8] = { 1.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, -1.0f };
+
+	// Offsets that decorrelate the two domain warp fields from the height field.
+	const float WARP_OFFSET_X[2] = { 5.2f, 1.7f };
+	const float WARP_OFFSET_Y[2] = { 1.3f, 9.2f };
+	// Offset between octaves so their lattices do not line up at the origin.
+	const float OCTAVE_OFFSET = 31.7f;
+}
+
+FTerrainNoise::FTerrainNoise(int32 Seed)
+{
+	FRandomStream RandomStream(Seed);
+
+	// Fisher-Yates shuffle of the identity permutation
+	for (int32 i = 0; i < 256; i++)
+	{
+		Permutation[i] = uint8(i);
+	}
+	for (int32 i = 255; i > 0; i--)
+	{
+		Swap(Permutation[i], Permutation[RandomStream.RandRange(0, i)]);
+	}
+	for (int32 i = 0; i < 256; i++)
+	{
+		Permutation[i + 256] = Permutation[i];
+	}
+
+	Offset = RandomStream.FRandRange(0.0f, 256.0f);
+}
+
+void FTerrainNoise::GetGradient(int32 Hash, float& OutX, float& OutY) const
+{
+	OutX = GRADIENTS_X[Hash & 7];
+	OutY = GRADIENTS_Y[Hash & 7];
+}
+
+float FTerrainNoise::SampleScalar(float X, float Y) const
+{
+	const float FloorX = FMath::FloorToFloat(X);
+	const float FloorY = FMath::FloorToFloat(Y);
+	const int32 XI = int32(FloorX) & 255;
+	const int32 YI = int32(FloorY) & 255;
+	const float FX = X - FloorX;
+	const float FY = Y - FloorY;
+
+	// Quintic fade curves
+	const float U = FX * FX * FX * (FX * (FX * 6.0f - 15.0f) + 10.0f);
+	const float V = FY * FY * FY * (FY * (FY * 6.0f - 15.0f) + 10.0f);
+
+	const int32 A = Permutation[XI] + YI;
+	const int32 B = Permutation[XI + 1] + YI;
+	float GAAX, GAAY, GBAX, GBAY, GABX, GABY, GBBX, GBBY;
+	GetGradient(Permutation[A], GAAX, GAAY);
+	GetGradient(Permutation[B], GBAX, GBAY);
+	GetGradient(Permutation[A + 1], GABX, GABY);
+	GetGradient(Permutation[B + 1], GBBX, GBBY);
+
+	const float NAA = GAAX * FX + GAAY * FY;
+	const float NBA = GBAX * (FX - 1.0f) + GBAY * FY;
+	const float NAB = GABX * FX + GABY * (FY - 1.0f);
+	const float NBB = GBBX * (FX - 1.0f) + GBBY * (FY - 1.0f);
+
+	const float Bottom = NAA + U * (NBA - NAA);
+	const float Top = NAB + U * (NBB - NAB);
+	return Bottom + V * (Top - Bottom);
+}
+
+void FTerrainNoise::Sample(const float* X, const float* Y, int32 Count, float* OutValues) const
+{
+	int32 i = 0;
+
+#if TERRAIN_NOISE_SSE
+	const __m128 One = _mm_set1_ps(1.0f);
+	const __m128 Six = _mm_set1_ps(6.0f);
+	const __m128 Fifteen = _mm_set1_ps(15.0f);
+	const __m128 Ten = _mm_set1_ps(10.0f);
+	const __m128i ByteMask = _mm_set1_epi32(255);
+
+	for (; i + 4 <= Count; i += 4)
+	{
+		const __m128 VX = _mm_loadu_ps(X + i);
+		const __m128 VY = _mm_loadu_ps(Y + i);
+
+		// Floor by truncating then stepping down where truncation rounded a negative value up
+		__m128 FloorX = _mm_cvtepi32_ps(_mm_cvttps_epi32(VX));
+		__m128 FloorY = _mm_cvtepi32_ps(_mm_cvttps_epi32(VY));
+		FloorX = _mm_sub_ps(FloorX, _mm_and_ps(_mm_cmpgt_ps(FloorX, VX), One));
+		FloorY = _mm_sub_ps(FloorY, _mm_and_ps(_mm_cmpgt_ps(FloorY, VY), One));
+
+		alignas(16) int32 XI[4];
+		alignas(16) int32 YI[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(XI), _mm_and_si128(_mm_cvttps_epi32(FloorX), ByteMask));
+		_mm_store_si128(reinterpret_cast<__m128i*>(YI), _mm_and_si128(_mm_cvttps_epi32(FloorY), ByteMask));
+
+		const __m128 FX = _mm_sub_ps(VX, FloorX);
+		const __m128 FY = _mm_sub_ps(VY, FloorY);
+		const __m128 FX1 = _mm_sub_ps(FX, One);
+		const __m128 FY1 = _mm_sub_ps(FY, One);
+
+		const __m128 U = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(FX, FX), FX), _mm_add_ps(_mm_mul_ps(FX, _mm_sub_ps(_mm_mul_ps(FX, Six), Fifteen)), Ten));
+		const __m128 V = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(FY, FY), FY), _mm_add_ps(_mm_mul_ps(FY, _mm_sub_ps(_mm_mul_ps(FY, Six), Fifteen)), Ten));
+
+		// The permutation lookups have no SSE2 gather so the gradients are fetched per lane
+		alignas(16) float GAAX[4], GAAY[4], GBAX[4], GBAY[4], GABX[4], GABY[4], GBBX[4], GBBY[4];
+		for (int32 Lane = 0; Lane < 4; Lane++)
+		{
+			const int32 A = Permutation[XI[Lane]] + YI[Lane];
+			const int32 B = Permutation[XI[Lane] + 1] + YI[Lane];
+			GetGradient(Permutation[A], GAAX[Lane], GAAY[Lane]);
+			GetGradient(Permutation[B], GBAX[Lane], GBAY[Lane]);
+			GetGradient(Permutation[A + 1], GABX[Lane], GABY[Lane]);
+			GetGradient(Permutation[B + 1], GBBX[Lane], GBBY[Lane]);
+		}
+
+		const __m128 NAA = _mm_add_ps(_mm_mul_ps(_mm_load_ps(GAAX), FX), _mm_mul_ps(_mm_load_ps(GAAY), FY));
+		const __m128 NBA = _mm_add_ps(_mm_mul_ps(_mm_load_ps(GBAX), FX1), _mm_mul_ps(_mm_load_ps(GBAY), FY));
+		const __m128 NAB = _mm_add_ps(_mm_mul_ps(_mm_load_ps(GABX), FX), _mm_mul_ps(_mm_load_ps(GABY), FY1));
+		const __m128 NBB = _mm_add_ps(_mm_mul_ps(_mm_load_ps(GBBX), FX1), _mm_mul_ps(_mm_load_ps(GBBY), FY1));
+
+		const __m128 Bottom = _mm_add_ps(NAA, _mm_mul_ps(U, _mm_sub_ps(NBA, NAA)));
+		const __m128 Top = _mm_add_ps(NAB, _mm_mul_ps(U, _mm_sub_ps(NBB, NAB)));
+		_mm_storeu_ps(OutValues + i, _mm_add_ps(Bottom, _mm_mul_ps(V, _mm_sub_ps(Top, Bottom))));
+	}
+#endif
+
+	// Whatever does not fill a full vector goes through the scalar path, which gives identical results
+	for (; i < Count; i++)
+	{
+		OutValues[i] = SampleScalar(X[i], Y[i]);
+	}
+}
+
+void FTerrainNoise::GenerateRow(const FTerrainNoiseSettings& Settings, int32 Row, int32 Width, float* OutHeights) const
+{
+	TArray<float> BaseX;
+	TArray<float> BaseY;
+	TArray<float> SampleX;
+	TArray<float> SampleY;
+	TArray<float> Values;
+	TArray<float> Sum;
+	BaseX.SetNumUninitialized(Width);
+	BaseY.SetNumUninitialized(Width);
+	SampleX.SetNumUninitialized(Width);
+	SampleY.SetNumUninitialized(Width);
+	Values.SetNumUninitialized(Width);
+	Sum.SetNumZeroed(Width);
+
+	for (int32 X = 0; X < Width; X++)
+	{
+		BaseX[X] = X * Settings.Frequency + Offset;
+		BaseY[X] = Row * Settings.Frequency + Offset;
+	}
+
+	// Push the sample positions around with two more noise fields
+	if (Settings.DomainWarpStrength > 0.0f)
+	{
+		const float WarpScale = Settings.DomainWarpStrength * Settings.Frequency;
+		TArray<float> WarpX;
+		WarpX.SetNumUninitialized(Width);
+		for (int32 Axis = 0; Axis < 2; Axis++)
+		{
+			for (int32 X = 0; X < Width; X++)
+			{
+				SampleX[X] = BaseX[X] + WARP_OFFSET_X[Axis];
+				SampleY[X] = BaseY[X] + WARP_OFFSET_Y[Axis];
+			}
+			Sample(SampleX.GetData(), SampleY.GetData(), Width, Axis == 0 ? WarpX.GetData() : Values.GetData());
+		}
+		for (int32 X = 0; X < Width; X++)
+		{
+			BaseX[X] = BaseX[X] + WarpX[X] * WarpScale;
+			BaseY[X] = BaseY[X] + Values[X] * WarpScale;
+		}
+	}
+
+	float OctaveFrequency = 1.0f;
+	float OctaveAmplitude = 1.0f;
+	float AmplitudeSum = 0.0f;
+	for (int32 Octave = 0; Octave < FMath::Max(Settings.Octaves, 1); Octave++)
+	{
+		for (int32 X = 0; X < Width; X++)
+		{
+			SampleX[X] = BaseX[X] * OctaveFrequency + Octave * OCTAVE_OFFSET;
+			SampleY[X] = BaseY[X] * OctaveFrequency + Octave * OCTAVE_OFFSET;
+		}
+		Sample(SampleX.GetData(), SampleY.GetData(), Width, Values.GetData());
+
+		for (int32 X = 0; X < Width; X++)
+		{
+			float Value = Values[X];
+			if (Settings.NoiseType == TerrainNoiseType::RIDGED)
+			{
+				Value = 1.0f - FMath::Abs(Value);
+				Value = Value * Value;
+			}
+			Sum[X] = Sum[X] + Value * OctaveAmplitude;
+		}
+
+		AmplitudeSum += OctaveAmplitude;
+		OctaveFrequency *= Settings.Lacunarity;
+		OctaveAmplitude *= Settings.Persistence;
+	}
+
+	// Normalise back to roughly -1 to 1 before scaling, ridged noise only produces positive values
+	for (int32 X = 0; X < Width; X++)
+	{
+		float Height = Sum[X] / AmplitudeSum;
+		if (Settings.NoiseType == TerrainNoiseType::RIDGED)
+		{
+			Height = Height * 2.0f - 1.0f;
+		}
+		OutHeights[X] = Height * Settings.Amplitude;
+	}
+}
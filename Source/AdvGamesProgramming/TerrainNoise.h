@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TerrainNoise.generated.h"
+
+UENUM()
+enum class TerrainNoiseType : uint8
+{
+	// Sum of octaves of gradient noise, a single octave gives smooth rolling hills.
+	FBM,
+	// Sharp ridges made by folding each octave around zero.
+	RIDGED
+};
+
+/**
+Parameters for generating terrain heights with FTerrainNoise.
+*/
+struct FTerrainNoiseSettings
+{
+	TerrainNoiseType NoiseType = TerrainNoiseType::FBM;
+	int32 Seed = 0;
+	int32 Octaves = 1;
+	// Grid coordinates are multiplied by this to get the noise coordinates of the first octave.
+	float Frequency = 0.1f;
+	// Heights are scaled by this after the octaves have been normalised to roughly -1 to 1.
+	float Amplitude = 1000.0f;
+	// How much the frequency grows with each octave.
+	float Lacunarity = 2.0f;
+	// How much the amplitude shrinks with each octave.
+	float Persistence = 0.5f;
+	// How far, in grid cells, the sample position is pushed around by a second noise field. Zero disables warping.
+	float DomainWarpStrength = 0.0f;
+};
+
+/**
+Seeded 2D gradient noise that works on whole rows of the heightfield at once.
+On x86 platforms four samples are evaluated together with SSE2, elsewhere a scalar path is used. Both paths perform
+the same IEEE single precision operations in the same order, so a seed always produces bit identical heights.
+*/
+class ADVGAMESPROGRAMMING_API FTerrainNoise
+{
+public:
+	explicit FTerrainNoise(int32 Seed);
+
+	/**
+	Evaluates the noise at a batch of points.
+	@param X - The X coordinate of each point.
+	@param Y - The Y coordinate of each point.
+	@param Count - The number of points.
+	@param OutValues - Filled with the noise value, roughly in the range -1 to 1, at each point.
+	*/
+	void Sample(const float* X, const float* Y, int32 Count, float* OutValues) const;
+
+	/**
+	Generates one row of terrain heights.
+	@param Settings - The noise parameters, the seed must match the one this noise was created with.
+	@param Row - The grid Y coordinate of the row.
+	@param Width - The number of heights in the row.
+	@param OutHeights - Filled with Width heights.
+	*/
+	void GenerateRow(const FTerrainNoiseSettings& Settings, int32 Row, int32 Width, float* OutHeights) const;
+
+private:
+	// Permutation of 0 to 255 repeated twice so lookups never need to wrap.
+	uint8 Permutation[512];
+	// Offset added to every coordinate so different seeds also sample different regions.
+	float Offset;
+
+	float SampleScalar(float X, float Y) const;
+	void GetGradient(int32 Hash, float& OutX, float& OutY) const;
+};
@@ -0,0 +1,124 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainSnapshot.h"
+
+FTerrainSnapshot::FTerrainSnapshot(const TArray<FVector>& Vertices, int32 InWidth, int32 InHeight, float InGridSize, uint32 InGeneration)
+	: Width(InWidth)
+	, Height(InHeight)
+	, GridSize(InGridSize)
+	, Generation(InGeneration)
+	, NumTilesX(FMath::DivideAndRoundUp(InWidth, TILE_SIZE))
+	, NumTilesY(FMath::DivideAndRoundUp(InHeight, TILE_SIZE))
+{
+	check(Vertices.Num() == Width * Height);
+
+	Tiles.Reserve(NumTilesX * NumTilesY);
+	for (int32 TileY = 0; TileY < NumTilesY; TileY++)
+	{
+		for (int32 TileX = 0; TileX < NumTilesX; TileX++)
+		{
+			Tiles.Add(MakeTile(Vertices, TileX, TileY));
+		}
+	}
+}
+
+FTerrainSnapshot::FTerrainSnapshot(const FTerrainSnapshot& Previous, const TArray<FVector>& Vertices, int32 MinX, int32 MinY, int32 MaxX, int32 MaxY, uint32 InGeneration)
+	: Width(Previous.Width)
+	, Height(Previous.Height)
+	, GridSize(Previous.GridSize)
+	, Generation(InGeneration)
+	, NumTilesX(Previous.NumTilesX)
+	, NumTilesY(Previous.NumTilesY)
+	, Tiles(Previous.Tiles)
+{
+	check(Vertices.Num() == Width * Height);
+
+	// Only the tiles overlapping the region are copied, the rest are shared with the previous snapshot
+	const int32 MinTileX = FMath::Clamp(MinX, 0, Width - 1) >> TILE_SHIFT;
+	const int32 MinTileY = FMath::Clamp(MinY, 0, Height - 1) >> TILE_SHIFT;
+	const int32 MaxTileX = FMath::Clamp(MaxX, 0, Width - 1) >> TILE_SHIFT;
+	const int32 MaxTileY = FMath::Clamp(MaxY, 0, Height - 1) >> TILE_SHIFT;
+	for (int32 TileY = MinTileY; TileY <= MaxTileY; TileY++)
+	{
+		for (int32 TileX = MinTileX; TileX <= MaxTileX; TileX++)
+		{
+			Tiles[TileY * NumTilesX + TileX] = MakeTile(Vertices, TileX, TileY);
+		}
+	}
+}
+
+FTerrainSnapshot::FTileRef FTerrainSnapshot::MakeTile(const TArray<FVector>& Vertices, int32 TileX, int32 TileY) const
+{
+	// The X and Y of every vertex come from its grid coordinates so only the heights need storing
+	TSharedRef<FTile, ESPMode::ThreadSafe> Tile = MakeShared<FTile, ESPMode::ThreadSafe>();
+	const int32 FirstX = TileX * TILE_SIZE;
+	const int32 FirstY = TileY * TILE_SIZE;
+	const int32 NumX = FMath::Min(TILE_SIZE, Width - FirstX);
+	const int32 NumY = FMath::Min(TILE_SIZE, Height - FirstY);
+	for (int32 Y = 0; Y < NumY; Y++)
+	{
+		for (int32 X = 0; X < NumX; X++)
+		{
+			Tile->Heights[Y * TILE_SIZE + X] = Vertices[(FirstY + Y) * Width + FirstX + X].Z;
+		}
+	}
+	return Tile;
+}
+
+void FTerrainSnapshot::GetCell(const FVector2D& Location, int32& OutCellX, int32& OutCellY, FVector2D& OutAlpha) const
+{
+	// Clamp to the last full cell so the vertex after the lower corner always exists
+	const float GridX = FMath::Clamp(Location.X / GridSize, 0.0f, float(Width - 1));
+	const float GridY = FMath::Clamp(Location.Y / GridSize, 0.0f, float(Height - 1));
+	OutCellX = FMath::Min(FMath::FloorToInt(GridX), Width - 2);
+	OutCellY = FMath::Min(FMath::FloorToInt(GridY), Height - 2);
+	OutAlpha = FVector2D(GridX - OutCellX, GridY - OutCellY);
+}
+
+float FTerrainSnapshot::GetHeightAt(const FVector2D& Location) const
+{
+	if (Width < 2 || Height < 2)
+	{
+		return Num() > 0 ? GetHeight(0, 0) : 0.0f;
+	}
+
+	int32 CellX;
+	int32 CellY;
+	FVector2D Alpha;
+	GetCell(Location, CellX, CellY, Alpha);
+	const float Bottom = FMath::Lerp(GetHeight(CellX, CellY), GetHeight(CellX + 1, CellY), Alpha.X);
+	const float Top = FMath::Lerp(GetHeight(CellX, CellY + 1), GetHeight(CellX + 1, CellY + 1), Alpha.X);
+	return FMath::Lerp(Bottom, Top, Alpha.Y);
+}
+
+FVector2D FTerrainSnapshot::GetGradientAt(const FVector2D& Location) const
+{
+	if (Width < 2 || Height < 2)
+	{
+		return FVector2D::ZeroVector;
+	}
+
+	int32 CellX;
+	int32 CellY;
+	FVector2D Alpha;
+	GetCell(Location, CellX, CellY, Alpha);
+	const float H00 = GetHeight(CellX, CellY);
+	const float H10 = GetHeight(CellX + 1, CellY);
+	const float H01 = GetHeight(CellX, CellY + 1);
+	const float H11 = GetHeight(CellX + 1, CellY + 1);
+	return FVector2D(
+		FMath::Lerp(H10 - H00, H11 - H01, Alpha.Y) / GridSize,
+		FMath::Lerp(H01 - H00, H11 - H10, Alpha.X) / GridSize);
+}
+
+FVector FTerrainSnapshot::GetNormalAt(const FVector2D& Location) const
+{
+	const FVector2D Gradient = GetGradientAt(Location);
+	return FVector(-Gradient.X, -Gradient.Y, 1.0f).GetSafeNormal();
+}
+
+float FTerrainSnapshot::GetSlopeAt(const FVector2D& Location) const
+{
+	return FMath::RadiansToDegrees(FMath::Atan(GetGradientAt(Location).Size()));
+}
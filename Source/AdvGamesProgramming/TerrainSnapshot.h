@@ -0,0 +1,99 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+Read-only copy of the heightfield of a generated map at one point in time.
+Snapshots are shared through reference counted handles so any number of consumers can read the terrain
+without copying it. When the terrain changes a new snapshot with a higher generation is published and
+consumers still holding the old one keep a consistent view until they switch over.
+The heights are stored in square tiles that are themselves shared, so a snapshot published after a local change
+only copies the tiles the change touched and shares the rest with the snapshot before it.
+*/
+class ADVGAMESPROGRAMMING_API FTerrainSnapshot
+{
+public:
+	/**
+	@param Vertices - The InWidth x InHeight grid of vertices, stored row by row, only their heights are kept.
+	@param InGridSize - The distance between neighbouring vertices.
+	@param InGeneration - Counts up every time the map publishes a new snapshot.
+	*/
+	FTerrainSnapshot(const TArray<FVector>& Vertices, int32 InWidth, int32 InHeight, float InGridSize, uint32 InGeneration);
+
+	/**
+	Makes a snapshot after a region of the heightfield changed, copying only the tiles that overlap the region.
+	@param Previous - The snapshot before the change, it must have the same grid layout as the vertices.
+	@param Vertices - The grid of vertices with the changed heights.
+	@param MinX, MinY, MaxX, MaxY - The inclusive grid coordinates of the changed vertices.
+	@param InGeneration - Counts up every time the map publishes a new snapshot.
+	*/
+	FTerrainSnapshot(const FTerrainSnapshot& Previous, const TArray<FVector>& Vertices, int32 MinX, int32 MinY, int32 MaxX, int32 MaxY, uint32 InGeneration);
+
+	int32 GetGridWidth() const { return Width; }
+	int32 GetGridHeight() const { return Height; }
+	float GetGridSize() const { return GridSize; }
+	uint32 GetGeneration() const { return Generation; }
+	int32 Num() const { return Width * Height; }
+
+	// The height of the vertex at grid coordinates (X, Y).
+	float GetHeight(int32 X, int32 Y) const
+	{
+		return Tiles[(Y >> TILE_SHIFT) * NumTilesX + (X >> TILE_SHIFT)]->Heights[((Y & TILE_MASK) << TILE_SHIFT) + (X & TILE_MASK)];
+	}
+
+	// The vertex at grid coordinates (X, Y) in the map's local space.
+	FVector GetVertex(int32 X, int32 Y) const { return FVector(X * GridSize, Y * GridSize, GetHeight(X, Y)); }
+	FVector GetVertex(int32 Index) const { return GetVertex(Index % Width, Index / Width); }
+
+	/**
+	Bilinearly interpolates the heightfield, locations outside the grid are clamped to its edge.
+	All three queries take a location in the map's local space and only look at four vertices.
+	@param Location - The local X and Y to sample at.
+	@return The terrain height at the location.
+	*/
+	float GetHeightAt(const FVector2D& Location) const;
+	// The surface normal of the bilinear surface at the location.
+	FVector GetNormalAt(const FVector2D& Location) const;
+	// The steepness of the terrain at the location in degrees, 0 is flat.
+	float GetSlopeAt(const FVector2D& Location) const;
+
+private:
+	// Tiles are 2^TILE_SHIFT vertices along each side so finding a vertex is a shift and a mask.
+	static const int32 TILE_SHIFT = 5;
+	static const int32 TILE_SIZE = 1 << TILE_SHIFT;
+	static const int32 TILE_MASK = TILE_SIZE - 1;
+
+	struct FTile
+	{
+		// Stored row by row, the parts of the tiles along the far edges that are off the grid are left unused.
+		float Heights[TILE_SIZE * TILE_SIZE];
+	};
+	typedef TSharedRef<const FTile, ESPMode::ThreadSafe> FTileRef;
+
+	const int32 Width;
+	const int32 Height;
+	const float GridSize;
+	const uint32 Generation;
+	const int32 NumTilesX;
+	const int32 NumTilesY;
+	TArray<FTileRef> Tiles;
+
+	// Copies the heights of one tile out of the vertices.
+	FTileRef MakeTile(const TArray<FVector>& Vertices, int32 TileX, int32 TileY) const;
+
+	/**
+	Finds the grid cell a location falls in.
+	@param OutCellX, OutCellY - The grid coordinates of the vertex at the lower corner of the cell.
+	@param OutAlpha - How far across the cell the location is along X and Y, from 0 to 1.
+	*/
+	void GetCell(const FVector2D& Location, int32& OutCellX, int32& OutCellY, FVector2D& OutAlpha) const;
+	// The slope of the bilinear surface along X and Y at the location.
+	FVector2D GetGradientAt(const FVector2D& Location) const;
+};
+
+typedef TSharedRef<const FTerrainSnapshot, ESPMode::ThreadSafe> FTerrainSnapshotRef;
+typedef TSharedPtr<const FTerrainSnapshot, ESPMode::ThreadSafe> FTerrainSnapshotPtr;
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FTerrainSnapshotPublished, FTerrainSnapshotRef);